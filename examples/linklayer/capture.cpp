@@ -0,0 +1,53 @@
+#include <linklayer/RawSocket.h>
+#include <linklayer/PcapWriter.h>
+#include <csignal>
+#include <cstring>
+
+using cpp_socket::linklayer::RawSocket;
+using cpp_socket::linklayer::PROMISCIOUS;
+using cpp_socket::linklayer::PcapWriter;
+using cpp_socket::linklayer::PCAP;
+using cpp_socket::linklayer::PCAPNG;
+using cpp_socket::base::PacketTimestamps;
+using cpp_socket::base::RX_SOFTWARE_TIMESTAMPS;
+
+volatile sig_atomic_t running = 1;
+
+void stop(int) {
+	running = 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cout << "usage: ./capture interface file [pcap|pcapng] [rotate_mb]" << std::endl;
+		return -1;
+	}
+	bool pcap = argc > 3 && strcmp(argv[3], "pcap") == 0;
+	size_t rotate = argc > 4 ? std::stoul(argv[4]) << 20 : 0;
+
+	RawSocket rawSocket(argv[1], PROMISCIOUS, true);
+	rawSocket.enable_timestamping(RX_SOFTWARE_TIMESTAMPS);
+	// wake up now and then to flush and check for ctrl+c
+	timeval timeout{0, 100000};
+	setsockopt(rawSocket.get_socket(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	PcapWriter writer(argv[2], pcap ? PCAP : PCAPNG, 65535, rotate);
+
+	struct sigaction action{};
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, nullptr);
+
+	unsigned char frame[65536];
+	while (running) {
+		PacketTimestamps timestamps;
+		int r = rawSocket.receive_timestamped(reinterpret_cast<char*>(frame), sizeof(frame), MSG_TRUNC, timestamps);
+		if (r <= 0) {
+			writer.flush();
+			continue;
+		}
+		writer.write(frame, std::min<size_t>(r, sizeof(frame)), timestamps, r);
+	}
+	writer.flush();
+	std::cout << writer.packet_count() << " packets captured, " << writer.dropped_count() << " dropped, "
+		<< writer.file_count() << " files" << std::endl;
+	return 0;
+}
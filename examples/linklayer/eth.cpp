@@ -1,15 +1,10 @@
 #include <linklayer/RawSocket.h>
+#include <linklayer/PacketView.h>
 #include <iomanip>
 
 using cpp_socket::linklayer::RawSocket;
 using cpp_socket::linklayer::PROMISCIOUS;
-
-struct EthernetFrame {
-	unsigned char destination_mac[6];
-	unsigned char source_mac[6];
-	unsigned char ether_type[2];
-	unsigned char payload[1500];
-};
+using cpp_socket::linklayer::PacketView;
 
 void print_mac(unsigned char* mac) {
 	for (int i = 0; i < 6; i++) {
@@ -28,22 +23,29 @@ int main(int argc, char **argv) {
 	RawSocket rawSocket(argv[1], PROMISCIOUS, true);
     rawSocket.set_ignore_outgoing(1);
 	while (true) {
-		EthernetFrame ethernetFrame;
-		int r = rawSocket.receive_wrapper(reinterpret_cast<char*>(&ethernetFrame), sizeof(ethernetFrame), 0);
+		unsigned char frame[65536];
+		int r = rawSocket.receive_wrapper(reinterpret_cast<char*>(frame), sizeof(frame), 0);
 		if (r <= 0) {
 			std::cout << "An error occured while reading from socket with code: " << cpp_socket::base::get_syscall_error() << std::endl;
+			continue;
+		}
+
+		PacketView packet(frame, r);
+		if (!packet.ethernet().valid()) {
+			continue;
+		}
+		std::cout << "Destination mac: ";
+		print_mac(packet.ethernet().destination());
+		std::cout << "Source mac: ";
+		print_mac(packet.ethernet().source());
+		std::cout << "Ether type: " << std::hex << std::setw(4) << std::setfill('0') << packet.ethernet().ether_type() << std::dec << std::endl;
+		if (packet.tcp().valid()) {
+			std::cout << "TCP " << packet.tcp().source_port() << " -> " << packet.tcp().destination_port() << std::endl;
 		}
-		else {
-			std::cout << "Destination mac: ";
-			print_mac(ethernetFrame.destination_mac);
-			std::cout << "Source mac: ";
-			print_mac(ethernetFrame.source_mac);
-			std::cout << "Ether type: ";
-			std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(ethernetFrame.ether_type[0]);
-			std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(ethernetFrame.ether_type[1]);
-			std::cout << std::dec << std::endl;
-			std::cout << "--------------------" << std::endl;
+		else if (packet.udp().valid()) {
+			std::cout << "UDP " << packet.udp().source_port() << " -> " << packet.udp().destination_port() << std::endl;
 		}
+		std::cout << "--------------------" << std::endl;
 	}
 	return 0;
 }
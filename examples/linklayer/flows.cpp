@@ -0,0 +1,75 @@
+#include <linklayer/RawSocket.h>
+#include <linklayer/FlowTable.h>
+#include <linklayer/PacketView.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <vector>
+
+using cpp_socket::linklayer::RawSocket;
+using cpp_socket::linklayer::PROMISCIOUS;
+using cpp_socket::linklayer::FANOUT_HASH;
+using cpp_socket::linklayer::PacketView;
+using cpp_socket::linklayer::FlowKey;
+using cpp_socket::linklayer::FlowTable;
+using cpp_socket::base::PacketTimestamps;
+
+struct FlowStats {
+	uint64_t packets = 0;
+	uint64_t bytes = 0;
+};
+
+void print_flow(int thread, const FlowKey& key, const FlowStats& stats) {
+	char source[INET6_ADDRSTRLEN];
+	char destination[INET6_ADDRSTRLEN];
+	inet_ntop(key.family, key.source, source, sizeof(source));
+	inet_ntop(key.family, key.destination, destination, sizeof(destination));
+	std::cout << "[" << thread << "] " << static_cast<int>(key.protocol) << " " << source << ":" << key.source_port << " <-> "
+		<< destination << ":" << key.destination_port << " " << stats.packets << " packets " << stats.bytes << " bytes" << std::endl;
+}
+
+// one socket, table and thread per shard, fanout keeps both directions of a flow on one of them
+void capture(std::string ifname, int thread) {
+	RawSocket rawSocket(ifname, PROMISCIOUS, true);
+	if (rawSocket.set_fanout(0x4242, FANOUT_HASH) == -1) {
+		std::cout << "fanout failed: " << cpp_socket::base::get_syscall_error() << std::endl;
+		return;
+	}
+	// wake up now and then to expire flows while there is no traffic
+	timeval timeout{1, 0};
+	setsockopt(rawSocket.get_socket(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	// idle flows are reported and dropped after 2 s
+	FlowTable<FlowStats> flows(1 << 20, 2000000000);
+	unsigned char frame[65536];
+	while (true) {
+		int r = rawSocket.receive_wrapper(reinterpret_cast<char*>(frame), sizeof(frame), 0);
+		int64_t now = PacketTimestamps::now_ns();
+		PacketView packet(frame, r > 0 ? r : 0);
+		FlowKey key;
+		if (r > 0 && FlowKey::from_packet(packet, key)) {
+			FlowStats* stats = flows.find_or_insert(key, now);
+			if (stats != nullptr) {
+				stats->packets++;
+				stats->bytes += r;
+			}
+		}
+		flows.expire(now, r > 0 ? 64 : flows.capacity(), [thread](const FlowKey& key, FlowStats& stats) {
+			print_flow(thread, key, stats);
+		});
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cout << "usage: ./flows interface [threads]" << std::endl;
+		return -1;
+	}
+	int threads = argc > 2 ? std::stoi(argv[2]) : 2;
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threads; i++) {
+		workers.emplace_back(capture, std::string(argv[1]), i);
+	}
+	for (std::thread& worker: workers) {
+		worker.join();
+	}
+	return 0;
+}
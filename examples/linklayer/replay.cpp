@@ -0,0 +1,78 @@
+#include <linklayer/RawSocket.h>
+#include <linklayer/PcapReplay.h>
+#include <arpa/inet.h>
+#include <cstring>
+
+using cpp_socket::linklayer::RawSocket;
+using cpp_socket::linklayer::PROMISCIOUS;
+using cpp_socket::linklayer::PcapReader;
+using cpp_socket::linklayer::PcapReplay;
+using cpp_socket::linklayer::PacketView;
+using cpp_socket::linklayer::ReplayStats;
+using cpp_socket::linklayer::ORIGINAL_TIMING;
+using cpp_socket::linklayer::FIXED_PPS;
+using cpp_socket::linklayer::FIXED_BPS;
+using cpp_socket::linklayer::MAX_SPEED;
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cout << "usage: ./replay interface file [original speed|pps rate|bps rate|max] [loops] [destination ip]" << std::endl;
+		return -1;
+	}
+	RawSocket rawSocket(argv[1], PROMISCIOUS, true);
+	rawSocket.set_qdisc_bypass(true);
+	PcapReader reader(argv[2]);
+	PcapReplay replay(rawSocket, reader);
+
+	int next = 3;
+	if (argc > next) {
+		if (strcmp(argv[next], "max") == 0) {
+			replay.set_pacing(MAX_SPEED);
+			next++;
+		}
+		else if (argc > next + 1) {
+			double rate = std::stod(argv[next + 1]);
+			if (strcmp(argv[next], "pps") == 0) {
+				replay.set_pacing(FIXED_PPS, rate);
+			}
+			else if (strcmp(argv[next], "bps") == 0) {
+				replay.set_pacing(FIXED_BPS, rate);
+			}
+			else {
+				replay.set_pacing(ORIGINAL_TIMING, rate);
+			}
+			next += 2;
+		}
+	}
+	if (argc > next) {
+		replay.set_loops(std::stoi(argv[next++]));
+	}
+	if (argc > next) {
+		// send every IPv4 frame to another host, checksums are patched incrementally
+		uint32_t destination;
+		if (inet_pton(AF_INET, argv[next], &destination) != 1) {
+			std::cout << "invalid destination ip" << std::endl;
+			return -1;
+		}
+		replay.set_rewrite([destination](PacketView& packet) {
+			if (!packet.ipv4().valid()) {
+				return;
+			}
+			uint32_t before = htonl(packet.ipv4().destination());
+			packet.ipv4().set_destination(ntohl(destination));
+			if (packet.tcp().valid()) {
+				packet.tcp().patch_checksum(before, destination);
+			}
+			else if (packet.udp().valid()) {
+				packet.udp().patch_checksum(before, destination);
+			}
+		});
+	}
+
+	ReplayStats stats = replay.run();
+	std::cout << stats.packets << " packets, " << stats.bytes << " bytes in " << stats.elapsed_ns / 1e6 << " ms" << std::endl;
+	std::cout << stats.packets_per_second << " pps, " << stats.bits_per_second / 1e6 << " Mbit/s" << std::endl;
+	std::cout << "pacing error: mean " << stats.mean_pacing_error_ns << " ns, max " << stats.max_pacing_error_ns << " ns" << std::endl;
+	std::cout << "send errors: " << stats.send_errors << std::endl;
+	return 0;
+}
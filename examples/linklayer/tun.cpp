@@ -0,0 +1,80 @@
+#include <linklayer/TunTapDevice.h>
+#include <linklayer/PacketView.h>
+#include <poll.h>
+#include <thread>
+#include <vector>
+
+using cpp_socket::linklayer::TunTapDevice;
+using cpp_socket::linklayer::TUN_DEVICE;
+using cpp_socket::linklayer::Ipv4View;
+using cpp_socket::linklayer::IcmpView;
+
+static constexpr int BATCH = 32;
+static constexpr uint8_t ECHO_REQUEST = 8;
+static constexpr uint8_t ECHO_REPLY = 0;
+
+// turns an echo request into its reply in place
+bool answer(unsigned char* packet, int size) {
+	Ipv4View ip(packet, size);
+	if (!ip.valid() || ip.protocol() != IPPROTO_ICMP) {
+		return false;
+	}
+	IcmpView icmp(ip.payload(), ip.payload_size());
+	if (!icmp.valid() || icmp.type() != ECHO_REQUEST) {
+		return false;
+	}
+	uint32_t source = ip.source();
+	ip.set_source(ip.destination());
+	ip.set_destination(source);
+	ip.payload()[0] = ECHO_REPLY;
+	icmp.update_checksum();
+	return true;
+}
+
+// each queue is served by its own thread, the kernel keeps a flow on one queue
+void serve(TunTapDevice& device, int queue) {
+	std::vector<unsigned char> buffers(BATCH * 2048);
+	iovec frames[BATCH];
+	int sizes[BATCH];
+	pollfd pfd{device.queue_fd(queue), POLLIN, 0};
+	while (true) {
+		poll(&pfd, 1, -1);
+		for (int i = 0; i < BATCH; i++) {
+			frames[i].iov_base = &buffers[i * 2048];
+			frames[i].iov_len = 2048;
+		}
+		int n = device.read_batch(queue, frames, BATCH, sizes);
+		int replies = 0;
+		for (int i = 0; i < n; i++) {
+			if (answer(static_cast<unsigned char*>(frames[i].iov_base), sizes[i])) {
+				frames[replies].iov_base = frames[i].iov_base;
+				frames[replies].iov_len = sizes[i];
+				replies++;
+			}
+		}
+		if (replies > 0 && device.write_batch(queue, frames, replies) == -1) {
+			perror("write");
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cout << "usage: sudo ./tun name [queues]" << std::endl;
+		std::cout << "then: ip addr add 10.9.0.1/24 dev name; ping 10.9.0.2" << std::endl;
+		return -1;
+	}
+	int queues = argc > 2 ? std::stoi(argv[2]) : 2;
+	TunTapDevice device(argv[1], TUN_DEVICE, queues);
+	device.set_up(true);
+	std::cout << "answering pings on " << device.get_ifname() << " with " << device.queue_count() << " queues" << std::endl;
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < device.queue_count(); i++) {
+		workers.emplace_back(serve, std::ref(device), i);
+	}
+	for (std::thread& worker: workers) {
+		worker.join();
+	}
+	return 0;
+}
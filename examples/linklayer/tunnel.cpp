@@ -3,6 +3,8 @@
 
 using cpp_socket::linklayer::RawSocket;
 using cpp_socket::linklayer::PROMISCIOUS;
+using cpp_socket::linklayer::vnet_header_t;
+using cpp_socket::linklayer::VNET_DATA_VALID;
 
 void tunnel(RawSocket& i1, RawSocket& i2) {
     while (true) {
@@ -24,15 +26,40 @@ void tunnel(RawSocket& i1, RawSocket& i2) {
     }
 }
 
+// super-frames are passed on whole, the GSO and checksum state travels in the vnet header
+void tunnel_vnet(RawSocket& i1, RawSocket& i2) {
+    static thread_local unsigned char buffer[65536];
+    while (true) {
+        vnet_header_t header;
+        int r = i1.receive_vnet(buffer, sizeof(buffer), header);
+
+        if (r < 0) {
+            std::string error_message = "Error reading from " + i1.get_ifname();
+            perror(error_message.c_str());
+            continue;
+        }
+
+        // only meaningful on receive
+        header.flags &= ~VNET_DATA_VALID;
+        r = i2.send_vnet(buffer, r, header);
+
+        if (r < 0) {
+            std::string error_message = "Error sending to " + i2.get_ifname();
+            perror(error_message.c_str());
+        }
+    }
+}
+
 int main(int argc, char** argv) {
 
-    if (argc != 3) {
-        std::cerr << "Usage: sudo ./tunnel <interface1> <interface2>" << std::endl;
+    if (argc != 3 && !(argc == 4 && std::string(argv[3]) == "--vnet")) {
+        std::cerr << "Usage: sudo ./tunnel <interface1> <interface2> [--vnet]" << std::endl;
         return 0;
     }
 
     std::string ifname1(argv[1]);
     std::string ifname2(argv[2]);
+    bool vnet = argc == 4;
 
     RawSocket i1(ifname1, PROMISCIOUS, true);
     RawSocket i2(ifname2, PROMISCIOUS, true);
@@ -40,12 +67,17 @@ int main(int argc, char** argv) {
     i1.set_ignore_outgoing(1);
     i2.set_ignore_outgoing(1);
 
+    if (vnet && (i1.enable_vnet_header(true) == -1 || i2.enable_vnet_header(true) == -1)) {
+        perror("Failed to enable PACKET_VNET_HDR");
+        return -1;
+    }
+
     std::thread i1_thread([&]() {
-        tunnel(i1, i2);
+        vnet ? tunnel_vnet(i1, i2) : tunnel(i1, i2);
     });
 
     std::thread i2_thread([&]() {
-        tunnel(i2, i1);
+        vnet ? tunnel_vnet(i2, i1) : tunnel(i2, i1);
     });
 
     i1_thread.join();
@@ -53,4 +85,3 @@ int main(int argc, char** argv) {
 
     return 0;
 }
-
@@ -0,0 +1,62 @@
+#include <transportlayer/UdpSocket.h>
+#include <chrono>
+#include <thread>
+
+using cpp_socket::transportlayer::UdpSocket;
+using cpp_socket::transportlayer::UdpReceiveBatch;
+using cpp_socket::transportlayer::Datagram;
+using cpp_socket::base::IPV4;
+
+constexpr uint16_t SEGMENT_SIZE = 1400;
+constexpr int SEGMENTS_PER_SEND = 40;
+constexpr int SENDS = 20000;
+
+int main() {
+	try {
+		UdpSocket receiver(IPV4, "127.0.0.1", 0, true);
+		int gro = receiver.enable_gro(true);
+		receiver.set_socket_option(SOL_SOCKET, SO_RCVBUF, 8 << 20);
+		struct timeval timeout{1, 0};
+		setsockopt(receiver.get_socket(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		UdpSocket sender(IPV4, "127.0.0.1", 0, true);
+		if (sender.connect_to("127.0.0.1", receiver.get_local_port()) == SOCKET_ERROR) {
+			throw std::runtime_error("Failed to connect.");
+		}
+
+		size_t datagrams = 0;
+		size_t bytes = 0;
+		int syscalls = 0;
+		std::thread reader([&] {
+			UdpReceiveBatch batch;
+			while (receiver.receive_batch(batch) > 0) {
+				syscalls++;
+				for (const UdpReceiveBatch::Segment& segment: batch.segments()) {
+					datagrams++;
+					bytes += segment.size;
+				}
+			}
+		});
+
+		// several GSO buffers per sendmmsg, each cut into SEGMENTS_PER_SEND datagrams
+		std::vector<unsigned char> payload(SEGMENT_SIZE * SEGMENTS_PER_SEND, 'x');
+		std::vector<Datagram> batch(8, Datagram{payload.data(), payload.size(), nullptr, SEGMENT_SIZE});
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < SENDS; i += static_cast<int>(batch.size())) {
+			if (sender.send_batch(batch.data(), static_cast<int>(batch.size())) == SOCKET_ERROR) {
+				throw std::runtime_error("Failed to send.");
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		reader.join();
+
+		std::cout << "GRO " << (gro == 0 ? "on" : "off") << ", sent " << SENDS * SEGMENTS_PER_SEND
+			<< " datagrams in " << SENDS / batch.size() << " syscalls, received " << datagrams
+			<< " in " << syscalls << " syscalls, " << bytes * 8 / seconds / 1e9 << " Gbit/s" << std::endl;
+	} catch (std::runtime_error& e) {
+		std::cout << e.what() << std::endl;
+		std::cout << "Error code " << cpp_socket::base::get_syscall_error() << std::endl;
+	}
+
+	return 0;
+}
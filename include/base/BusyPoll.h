@@ -0,0 +1,48 @@
+#ifndef BUSY_POLL_H
+#define BUSY_POLL_H
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstdint>
+#include <ctime>
+
+namespace cpp_socket::base {
+	/*
+	Outcome of spin-then-block waits: a hit found work while spinning, a sleep gave
+	up after the spin budget and blocked in the kernel. A low hit ratio on a latency
+	critical path means the budget is shorter than the gaps between messages.
+	*/
+	struct SpinStats {
+		uint64_t spin_hits = 0;
+		uint64_t sleeps = 0;
+
+		double hit_ratio() const {
+			uint64_t total = spin_hits + sleeps;
+			return total == 0 ? 0 : static_cast<double>(spin_hits) / total;
+		}
+	};
+
+	inline int64_t monotonic_ns() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+
+	/*
+	Pins the calling thread to one CPU, a spinning thread should own its core
+	(isolated from the scheduler, e.g. isolcpus) or it competes with the work it waits for.
+	- Returns 0, or an error number on failure.
+	*/
+	inline int pin_thread(int cpu) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+} // namespace cpp_socket::base
+
+#endif // BUSY_POLL_H
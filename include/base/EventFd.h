@@ -0,0 +1,59 @@
+#ifndef EVENT_FD_H
+#define EVENT_FD_H
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::base {
+	/*
+	Non-blocking eventfd, the wakeup signal between a producer thread and a
+	consumer blocked in epoll. Register get_fd() for EPOLLIN on the consumer side.
+	*/
+	class EventFd {
+	public:
+		EventFd() {
+			if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+				throw std::runtime_error("Failed to create eventfd.");
+			}
+		}
+
+		EventFd(const EventFd&) = delete;
+		EventFd& operator=(const EventFd&) = delete;
+
+		~EventFd() {
+			close(fd);
+		}
+
+		int get_fd() {
+			return fd;
+		}
+
+		// safe to call from any thread, can only fail if the counter would overflow
+		void notify() {
+			uint64_t one = 1;
+			[[maybe_unused]] ssize_t r = write(fd, &one, sizeof(one));
+		}
+
+		/*
+		Resets the counter.
+		- Returns the number of notifications since the last drain.
+		*/
+		uint64_t drain() {
+			uint64_t value = 0;
+			if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+				return 0;
+			}
+			return value;
+		}
+	private:
+		int fd;
+	};
+} // namespace cpp_socket::base
+
+#endif // EVENT_FD_H
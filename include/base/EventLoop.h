@@ -0,0 +1,294 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "SocketWrapper.h"
+#include "EventFd.h"
+#include "LockFreeQueue.h"
+#include "TimerWheel.h"
+#include "BusyPoll.h"
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::base {
+	/*
+	epoll based reactor, file descriptors are registered with a Handler that is
+	called with the ready events. Only registered descriptors are looked at, so
+	idle connections cost nothing. A loop is driven by a single thread, other
+	threads talk to it through post(). Timers of timers() fire on the loop thread,
+	epoll_wait never sleeps past the next one.
+	*/
+	class EventLoop {
+	public:
+		class Handler {
+		public:
+			/*
+			- events: EPOLLIN, EPOLLOUT, EPOLLERR, EPOLLHUP, EPOLLRDHUP
+			*/
+			virtual void on_events(uint32_t events) = 0;
+		protected:
+			~Handler() = default;
+		};
+
+		/*
+		- max_events: events dispatched per epoll_wait.
+		- task_capacity: tasks post() queues without taking a lock, more spill into a locked list.
+		*/
+		explicit EventLoop(int max_events = 256, size_t task_capacity = 1024)
+			:events(max_events), tasks(task_capacity) {
+			if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+				throw std::runtime_error("Failed to create epoll instance.");
+			}
+			epoll_event ev{};
+			ev.events = EPOLLIN;
+			ev.data.ptr = nullptr;
+			if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd.get_fd(), &ev) == -1) {
+				close(epoll_fd);
+				throw std::runtime_error("Failed to register eventfd.");
+			}
+		}
+
+		EventLoop(const EventLoop&) = delete;
+		EventLoop& operator=(const EventLoop&) = delete;
+
+		~EventLoop() {
+			close(epoll_fd);
+		}
+
+		/*
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int add(SOCKET_TYPE fd, uint32_t events, Handler* handler) {
+			return control(EPOLL_CTL_ADD, fd, events, handler);
+		}
+
+		int modify(SOCKET_TYPE fd, uint32_t events, Handler* handler) {
+			return control(EPOLL_CTL_MOD, fd, events, handler);
+		}
+
+		int remove(SOCKET_TYPE fd) {
+			return epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		}
+
+		/*
+		Runs the task on the loop thread after the events of the current iteration.
+		Safe to call from any thread, also used to defer destroying handlers that
+		may still have events pending in the current iteration. Tasks posted by
+		one thread run in the order they were posted.
+		The eventfd is only written if the loop is (about to be) blocked in epoll_wait.
+		*/
+		void post(std::function<void()> task) {
+			if (overflowed.load(std::memory_order_acquire) || !tasks.try_push(std::move(task))) {
+				// keep the order: once a task spilled, the following ones spill too until the loop drained them
+				std::lock_guard lock(overflow_mutex);
+				overflow.push_back(std::move(task));
+				overflowed.store(true, std::memory_order_release);
+			}
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (sleeping.load(std::memory_order_relaxed)) {
+				wakeup();
+			}
+		}
+
+		/*
+		Waits at most timeout_ms (-1 for no limit) for events and dispatches them.
+		The timeout is honoured after stop() as well, post() and wakeup() still interrupt it.
+		- Returns -1 if there is syscall error
+		- Returns the number of events, timers and tasks processed otherwise
+		*/
+		int run_once(int timeout_ms) {
+			loop_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+			int timer_timeout = timer_wheel.timeout_ms();
+			if (timer_timeout >= 0 && (timeout_ms < 0 || timer_timeout < timeout_ms)) {
+				timeout_ms = timer_timeout;
+			}
+			if (timeout_ms != 0) {
+				sleeping.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!tasks.empty() || overflowed.load(std::memory_order_relaxed)) {
+					timeout_ms = 0;
+				}
+			}
+			int n = epoll_wait(epoll_fd, events.data(), events.size(), timeout_ms);
+			sleeping.store(false, std::memory_order_relaxed);
+			if (n == -1) {
+				return errno == INTR_ERROR ? 0 : -1;
+			}
+
+			bool woken = false;
+			for (int i = 0; i < n; i++) {
+				Handler* handler = static_cast<Handler*>(events[i].data.ptr);
+				if (handler == nullptr) {
+					woken = true;
+				}
+				else {
+					handler->on_events(events[i].events);
+				}
+			}
+
+			if (woken) {
+				wakeup_fd.drain();
+			}
+			n += timer_wheel.advance();
+			return n + run_tasks();
+		}
+
+		/*
+		Runs until stop() is called.
+		- Returns -1 if there is syscall error, 0 otherwise.
+		*/
+		int run() {
+			while (!stopped) {
+				if (run_once(-1) == -1) {
+					return -1;
+				}
+			}
+			return 0;
+		}
+
+		/*
+		Low latency mode: polls without sleeping while events keep coming, and only
+		blocks in epoll_wait after spin_ns without any. Tasks posted while it spins
+		need no eventfd write. See spin_stats for how often the spin paid off.
+		- cpu: pins the loop thread first, -1 leaves it unpinned.
+		- Returns -1 if there is syscall error (or pinning failed), 0 otherwise.
+		*/
+		int run_spinning(int64_t spin_ns, int cpu = -1) {
+			if (cpu >= 0 && pin_thread(cpu) != 0) {
+				return -1;
+			}
+			int64_t idle_since = monotonic_ns();
+			while (!stopped) {
+				int n = run_once(0);
+				if (n == -1) {
+					return -1;
+				}
+				if (n > 0) {
+					spin_hits.store(spin_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+					idle_since = monotonic_ns();
+					continue;
+				}
+				if (monotonic_ns() - idle_since < spin_ns) {
+					continue;
+				}
+				sleeps.store(sleeps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				if (run_once(-1) == -1) {
+					return -1;
+				}
+				idle_since = monotonic_ns();
+			}
+			return 0;
+		}
+
+		// hits and sleeps of run_spinning, safe to call from any thread
+		SpinStats spin_stats() {
+			return SpinStats{spin_hits.load(std::memory_order_relaxed), sleeps.load(std::memory_order_relaxed)};
+		}
+
+		/*
+		epoll busy polling (EPIOCSPARAMS, Linux 6.9): epoll_wait polls the device queues
+		of the registered sockets for up to usecs before sleeping, a socket wide
+		alternative to SocketWrapper::set_busy_poll.
+		- budget: packets per poll pass, 0 for the default.
+		- prefer: keep device interrupts deferred while polling, see SocketWrapper::set_prefer_busy_poll.
+		- Returns -1 on syscall error (ENOTTY on older kernels).
+		*/
+		int set_busy_poll(uint32_t usecs, uint16_t budget = 0, bool prefer = false) {
+			BusyPollParams params{usecs, budget, static_cast<uint8_t>(prefer ? 1 : 0), 0};
+			return ioctl(epoll_fd, SET_BUSY_POLL_PARAMS, &params);
+		}
+
+		// safe to call from any thread, also before run() is entered
+		void stop() {
+			stopped = true;
+			wakeup();
+		}
+
+		// only to be used from the loop thread
+		TimerWheel& timers() {
+			return timer_wheel;
+		}
+
+		bool is_loop_thread() {
+			return loop_thread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+		}
+
+		void wakeup() {
+			wakeup_fd.notify();
+		}
+	private:
+		// struct epoll_params and EPIOCSPARAMS of linux/eventpoll.h (6.9), missing from older headers
+		struct BusyPollParams {
+			uint32_t busy_poll_usecs;
+			uint16_t busy_poll_budget;
+			uint8_t prefer_busy_poll;
+			uint8_t padding;
+		};
+		static constexpr unsigned long SET_BUSY_POLL_PARAMS = _IOW(0x8A, 0x01, BusyPollParams);
+
+		int control(int op, SOCKET_TYPE fd, uint32_t events, Handler* handler) {
+			epoll_event ev{};
+			ev.events = events;
+			ev.data.ptr = handler;
+			return epoll_ctl(epoll_fd, op, fd, &ev);
+		}
+
+		/*
+		Only the tasks queued when it starts are run, tasks posted by tasks run in the next iteration.
+		*/
+		int run_tasks() {
+			std::function<void()> task;
+			size_t limit = tasks.capacity();
+			while (running_tasks.size() < limit && tasks.try_pop(task)) {
+				running_tasks.push_back(std::move(task));
+			}
+			if (overflowed.load(std::memory_order_acquire)) {
+				/*
+				Spilled tasks were posted after everything their thread got into the queue,
+				producers spill while the lock is held, so the queue can be drained for good.
+				*/
+				std::lock_guard lock(overflow_mutex);
+				while (tasks.try_pop(task)) {
+					running_tasks.push_back(std::move(task));
+				}
+				for (std::function<void()>& spilled: overflow) {
+					running_tasks.push_back(std::move(spilled));
+				}
+				overflow.clear();
+				overflowed.store(false, std::memory_order_release);
+			}
+			int n = running_tasks.size();
+			for (std::function<void()>& t: running_tasks) {
+				t();
+			}
+			running_tasks.clear();
+			return n;
+		}
+
+		int epoll_fd;
+		EventFd wakeup_fd;
+		std::vector<epoll_event> events;
+
+		MpscQueue<std::function<void()>> tasks;
+		std::vector<std::function<void()>> running_tasks;
+		std::atomic<bool> overflowed = false;
+		std::mutex overflow_mutex;
+		std::vector<std::function<void()>> overflow;
+		std::atomic<bool> sleeping = false;
+		TimerWheel timer_wheel;
+
+		std::atomic<bool> stopped = false;
+		std::atomic<std::thread::id> loop_thread;
+		std::atomic<uint64_t> spin_hits = 0;
+		std::atomic<uint64_t> sleeps = 0;
+	};
+} // namespace cpp_socket::base
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,112 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace cpp_socket::base {
+	/*
+	Log-linear histogram of non-negative values (e.g. nanoseconds), every power of two
+	range is split into SUB_BUCKETS linear buckets, so the relative error of any
+	reported percentile stays below 1/SUB_BUCKETS. Recording is O(1) and allocation free.
+	Not thread safe, keep one per thread and merge() them for reporting.
+	*/
+	class LatencyHistogram {
+	public:
+		static constexpr int SUB_BUCKET_BITS = 4;
+		static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+		void record(int64_t value) {
+			if (value < 0) {
+				value = 0;
+			}
+			uint64_t v = static_cast<uint64_t>(value);
+			buckets[bucket_index(v)]++;
+			total++;
+			sum += v;
+			min_value = std::min(min_value, v);
+			max_value = std::max(max_value, v);
+		}
+
+		void merge(const LatencyHistogram& other) {
+			for (size_t i = 0; i < buckets.size(); i++) {
+				buckets[i] += other.buckets[i];
+			}
+			total += other.total;
+			sum += other.sum;
+			min_value = std::min(min_value, other.min_value);
+			max_value = std::max(max_value, other.max_value);
+		}
+
+		void reset() {
+			*this = LatencyHistogram();
+		}
+
+		/*
+		- Returns the upper bound of the bucket holding the given percentile (0 to 100).
+		- Returns 0 if nothing was recorded.
+		*/
+		uint64_t percentile(double p) const {
+			if (total == 0) {
+				return 0;
+			}
+			uint64_t rank = static_cast<uint64_t>(p / 100.0 * total);
+			rank = std::clamp<uint64_t>(rank, 1, total);
+
+			uint64_t seen = 0;
+			for (size_t i = 0; i < buckets.size(); i++) {
+				seen += buckets[i];
+				if (seen >= rank) {
+					return std::min(bucket_upper_bound(i), max_value);
+				}
+			}
+			return max_value;
+		}
+
+		uint64_t count() const {
+			return total;
+		}
+
+		uint64_t min() const {
+			return total == 0 ? 0 : min_value;
+		}
+
+		uint64_t max() const {
+			return max_value;
+		}
+
+		double mean() const {
+			return total == 0 ? 0 : static_cast<double>(sum) / total;
+		}
+	private:
+		// values below SUB_BUCKETS get exact buckets, above that each power of two gets SUB_BUCKETS
+		static size_t bucket_index(uint64_t v) {
+			if (v < SUB_BUCKETS) {
+				return v;
+			}
+			int exponent = std::bit_width(v) - 1 - SUB_BUCKET_BITS;
+			uint64_t sub = (v >> exponent) - SUB_BUCKETS;
+			return (exponent + 1) * SUB_BUCKETS + sub;
+		}
+
+		static uint64_t bucket_upper_bound(size_t index) {
+			if (index < SUB_BUCKETS) {
+				return index;
+			}
+			int exponent = static_cast<int>(index / SUB_BUCKETS) - 1;
+			uint64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+			return ((sub + 1) << exponent) - 1;
+		}
+
+		std::array<uint64_t, (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS> buckets{};
+		uint64_t total = 0;
+		uint64_t sum = 0;
+		uint64_t min_value = std::numeric_limits<uint64_t>::max();
+		uint64_t max_value = 0;
+	};
+} // namespace cpp_socket::base
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,196 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace cpp_socket::base {
+	inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+	inline size_t round_up_power_of_two(size_t value) {
+		size_t power = 1;
+		while (power < value) {
+			power <<= 1;
+		}
+		return power;
+	}
+
+	/*
+	Bounded single producer, single consumer ring buffer. Producer and consumer
+	indices live on separate cache lines and each side caches the other's index,
+	so a push or pop usually touches no shared cache line besides the slot.
+	- T: default constructible and movable.
+	- capacity: rounded up to a power of two.
+	*/
+	template <typename T>
+	class SpscQueue {
+	public:
+		explicit SpscQueue(size_t capacity)
+			:mask(round_up_power_of_two(capacity) - 1), slots(new T[mask + 1]) {
+			if (capacity == 0) {
+				throw std::runtime_error("Queue capacity must not be 0.");
+			}
+		}
+
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		/*
+		Producer only.
+		- Returns false if the queue is full, value is left untouched.
+		*/
+		bool try_push(T&& value) {
+			size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head_cache > mask) {
+				head_cache = head.load(std::memory_order_acquire);
+				if (t - head_cache > mask) {
+					return false;
+				}
+			}
+			slots[t & mask] = std::move(value);
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool try_push(const T& value) {
+			T copy = value;
+			return try_push(std::move(copy));
+		}
+
+		/*
+		Consumer only.
+		- Returns false if the queue is empty.
+		*/
+		bool try_pop(T& value) {
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail_cache) {
+				tail_cache = tail.load(std::memory_order_acquire);
+				if (h == tail_cache) {
+					return false;
+				}
+			}
+			value = std::move(slots[h & mask]);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// approximate when called from the producer
+		bool empty() {
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+
+		size_t capacity() {
+			return mask + 1;
+		}
+	private:
+		const size_t mask;
+		std::unique_ptr<T[]> slots;
+
+		// producer side
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail = 0;
+		size_t head_cache = 0;
+
+		// consumer side
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> head = 0;
+		size_t tail_cache = 0;
+	};
+
+	/*
+	Bounded multi producer, single consumer queue (Vyukov's sequenced ring). Producers
+	claim a slot with one CAS and publish it with the slot's sequence number, so a slow
+	producer never blocks the others from claiming, only the consumer waits for its slot.
+	- T: default constructible and movable.
+	- capacity: rounded up to a power of two.
+	*/
+	template <typename T>
+	class MpscQueue {
+	public:
+		explicit MpscQueue(size_t capacity)
+			:mask(round_up_power_of_two(capacity) - 1), cells(new Cell[mask + 1]) {
+			if (capacity == 0) {
+				throw std::runtime_error("Queue capacity must not be 0.");
+			}
+			for (size_t i = 0; i <= mask; i++) {
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		/*
+		Safe to call from any thread.
+		- Returns false if the queue is full, value is left untouched.
+		*/
+		bool try_push(T&& value) {
+			Cell* cell;
+			size_t position = enqueue_position.load(std::memory_order_relaxed);
+			while (true) {
+				cell = &cells[position & mask];
+				size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+				if (difference == 0) {
+					if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else if (difference < 0) {
+					return false;
+				}
+				else {
+					position = enqueue_position.load(std::memory_order_relaxed);
+				}
+			}
+			cell->value = std::move(value);
+			cell->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool try_push(const T& value) {
+			T copy = value;
+			return try_push(std::move(copy));
+		}
+
+		/*
+		Consumer only.
+		- Returns false if the queue is empty or the next slot is claimed but not published yet.
+		*/
+		bool try_pop(T& value) {
+			Cell& cell = cells[dequeue_position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeue_position + 1) < 0) {
+				return false;
+			}
+			value = std::move(cell.value);
+			cell.sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+			dequeue_position++;
+			return true;
+		}
+
+		// consumer only
+		bool empty() {
+			size_t sequence = cells[dequeue_position & mask].sequence.load(std::memory_order_acquire);
+			return static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeue_position + 1) < 0;
+		}
+
+		size_t capacity() {
+			return mask + 1;
+		}
+	private:
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		const size_t mask;
+		std::unique_ptr<Cell[]> cells;
+
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_position = 0;
+		alignas(CACHE_LINE_SIZE) size_t dequeue_position = 0;
+	};
+} // namespace cpp_socket::base
+
+#endif // LOCK_FREE_QUEUE_H
@@ -0,0 +1,62 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::base {
+	/*
+	Non-blocking pipe, the in-kernel buffer splice moves pages through without copying
+	them to userspace.
+	*/
+	class Pipe {
+	public:
+		Pipe() {
+			int fds[2];
+			if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+				throw std::runtime_error("Failed to create pipe.");
+			}
+			read_end = fds[0];
+			write_end = fds[1];
+		}
+
+		Pipe(const Pipe&) = delete;
+		Pipe& operator=(const Pipe&) = delete;
+
+		~Pipe() {
+			close(read_end);
+			close(write_end);
+		}
+
+		int read_fd() {
+			return read_end;
+		}
+
+		int write_fd() {
+			return write_end;
+		}
+
+		/*
+		Bigger pipes move more per splice call, unprivileged processes are capped by
+		/proc/sys/fs/pipe-max-size.
+		- Returns the resulting capacity, -1 on syscall error.
+		*/
+		int set_capacity(int bytes) {
+			return fcntl(write_end, F_SETPIPE_SZ, bytes);
+		}
+
+		int get_capacity() {
+			return fcntl(write_end, F_GETPIPE_SZ);
+		}
+	private:
+		int read_end;
+		int write_end;
+	};
+} // namespace cpp_socket::base
+
+#endif // PIPE_H
@@ -0,0 +1,176 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace cpp_socket::base {
+	/*
+	Growable FIFO on a power of two ring, for the per connection queues of a socket.
+	Unlike std::deque it allocates nothing until the first push and keeps its capacity
+	when it drains, so an idle connection costs no heap memory and a busy one stops
+	allocating once the ring is big enough. Single threaded.
+	- T: default constructible and movable, popped slots are reset to T().
+	*/
+	template <typename T>
+	class RingQueue {
+	public:
+		class iterator {
+		public:
+			iterator(RingQueue* queue, size_t index)
+				:queue(queue), index(index) {
+
+			}
+
+			T& operator*() const {
+				return (*queue)[index];
+			}
+
+			T* operator->() const {
+				return &(*queue)[index];
+			}
+
+			iterator& operator++() {
+				index++;
+				return *this;
+			}
+
+			bool operator==(const iterator& other) const {
+				return index == other.index;
+			}
+		private:
+			RingQueue* queue;
+			size_t index;
+		};
+
+		RingQueue() = default;
+
+		RingQueue(RingQueue&& other) noexcept
+			:slots(std::move(other.slots)), head(std::exchange(other.head, 0)), count(std::exchange(other.count, 0)) {
+
+		}
+
+		RingQueue& operator=(RingQueue&& other) noexcept {
+			slots = std::move(other.slots);
+			head = std::exchange(other.head, 0);
+			count = std::exchange(other.count, 0);
+			return *this;
+		}
+
+		bool empty() const {
+			return count == 0;
+		}
+
+		size_t size() const {
+			return count;
+		}
+
+		size_t capacity() const {
+			return slots.size();
+		}
+
+		T& operator[](size_t index) {
+			return slots[(head + index) & (slots.size() - 1)];
+		}
+
+		T& front() {
+			return slots[head];
+		}
+
+		T& back() {
+			return (*this)[count - 1];
+		}
+
+		iterator begin() {
+			return iterator(this, 0);
+		}
+
+		iterator end() {
+			return iterator(this, count);
+		}
+
+		void push_back(T value) {
+			if (count == slots.size()) {
+				grow();
+			}
+			(*this)[count] = std::move(value);
+			count++;
+		}
+
+		void pop_front() {
+			slots[head] = T();
+			head = (head + 1) & (slots.size() - 1);
+			count--;
+		}
+
+		// keeps the capacity
+		void clear() {
+			while (count > 0) {
+				pop_front();
+			}
+			head = 0;
+		}
+
+		// removes the matching elements, the others keep their order
+		template <typename Predicate>
+		size_t erase_if(Predicate predicate) {
+			size_t kept = 0;
+			for (size_t i = 0; i < count; i++) {
+				if (!predicate((*this)[i])) {
+					if (kept != i) {
+						(*this)[kept] = std::move((*this)[i]);
+					}
+					kept++;
+				}
+			}
+			size_t erased = count - kept;
+			for (size_t i = kept; i < count; i++) {
+				(*this)[i] = T();
+			}
+			count = kept;
+			return erased;
+		}
+
+		/*
+		Gives back the ring of a drained queue, or halves it while it is less than a
+		quarter full, e.g. once a burst is over.
+		*/
+		void shrink_to_fit() {
+			if (count == 0) {
+				slots = std::vector<T>();
+				head = 0;
+			}
+			else {
+				size_t capacity = slots.size();
+				while (capacity > MIN_CAPACITY && count < capacity / 4) {
+					capacity /= 2;
+				}
+				if (capacity != slots.size()) {
+					resize(capacity);
+				}
+			}
+		}
+	private:
+		static constexpr size_t MIN_CAPACITY = 8;
+
+		void grow() {
+			resize(slots.empty() ? MIN_CAPACITY : slots.size() * 2);
+		}
+
+		void resize(size_t capacity) {
+			std::vector<T> resized(capacity);
+			for (size_t i = 0; i < count; i++) {
+				resized[i] = std::move((*this)[i]);
+			}
+			slots = std::move(resized);
+			head = 0;
+		}
+
+		std::vector<T> slots;
+		size_t head = 0;
+		size_t count = 0;
+	};
+} // namespace cpp_socket::base
+
+#endif // RING_QUEUE_H
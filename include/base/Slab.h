@@ -0,0 +1,170 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <base/LockFreeQueue.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace cpp_socket::base {
+	/*
+	Reference to an object in a Slab. The generation changes every time the slot is
+	freed, so a handle kept after its object was destroyed resolves to nullptr instead
+	of to whatever reused the slot.
+	*/
+	struct SlabHandle {
+		static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		bool valid() const {
+			return index != INVALID_INDEX;
+		}
+
+		bool operator==(const SlabHandle& other) const {
+			return index == other.index && generation == other.generation;
+		}
+	};
+
+	/*
+	Object pool for one thread, objects are constructed in fixed size chunks that are
+	kept for the life of the slab, so creating and destroying them only touches the heap
+	when the slab grows. Objects never move, pointers stay valid until destroy().
+	Not thread safe, let the owning thread resolve handles (e.g. through EventLoop::post).
+	- chunk_size: objects per chunk, rounded up to a power of two.
+	*/
+	template <typename T>
+	class Slab {
+	public:
+		explicit Slab(size_t chunk_size = 1024)
+			:chunk_shift(shift_of(round_up_power_of_two(chunk_size))), chunk_mask((size_t(1) << chunk_shift) - 1) {
+
+		}
+
+		Slab(const Slab&) = delete;
+		Slab& operator=(const Slab&) = delete;
+
+		~Slab() {
+			for (size_t i = 0; i < capacity(); i++) {
+				Slot& slot = slot_at(i);
+				if (is_live(slot.generation)) {
+					slot.object()->~T();
+				}
+			}
+		}
+
+		// allocates chunks up front so the first count creates do not allocate
+		void reserve(size_t count) {
+			while (capacity() < count) {
+				grow();
+			}
+		}
+
+		/*
+		- Returns the new object, handle is set to refer to it.
+		- Throws what T's constructor throws, the slot stays free then.
+		*/
+		template <typename... Args>
+		T* create(SlabHandle& handle, Args&&... args) {
+			if (free_head == SlabHandle::INVALID_INDEX) {
+				grow();
+			}
+			uint32_t index = free_head;
+			Slot& slot = slot_at(index);
+			new (slot.storage) T(std::forward<Args>(args)...);
+			free_head = slot.next_free;
+			slot.generation++;
+			live++;
+			handle = {index, slot.generation};
+			return slot.object();
+		}
+
+		// nullptr if the handle is stale or invalid
+		T* get(SlabHandle handle) {
+			if (handle.index >= capacity()) {
+				return nullptr;
+			}
+			Slot& slot = slot_at(handle.index);
+			return slot.generation == handle.generation && is_live(slot.generation) ? slot.object() : nullptr;
+		}
+
+		/*
+		Destroys the object, handles to it turn stale. A stale handle is ignored.
+		- Returns false if the handle was stale.
+		*/
+		bool destroy(SlabHandle handle) {
+			T* object = get(handle);
+			if (object == nullptr) {
+				return false;
+			}
+			object->~T();
+			Slot& slot = slot_at(handle.index);
+			slot.generation++;
+			slot.next_free = free_head;
+			free_head = handle.index;
+			live--;
+			return true;
+		}
+
+		size_t size() {
+			return live;
+		}
+
+		size_t capacity() {
+			return chunks.size() << chunk_shift;
+		}
+	private:
+		// odd generations are live, so a handle to a freed slot never matches
+		struct Slot {
+			alignas(T) unsigned char storage[sizeof(T)];
+			uint32_t generation = 0;
+			uint32_t next_free = SlabHandle::INVALID_INDEX;
+
+			T* object() {
+				return std::launder(reinterpret_cast<T*>(storage));
+			}
+		};
+
+		static bool is_live(uint32_t generation) {
+			return (generation & 1) != 0;
+		}
+
+		static size_t shift_of(size_t power) {
+			size_t shift = 0;
+			while ((size_t(1) << shift) < power) {
+				shift++;
+			}
+			return shift;
+		}
+
+		Slot& slot_at(size_t index) {
+			return chunks[index >> chunk_shift][index & chunk_mask];
+		}
+
+		// the slots of a new chunk are used next, lowest index first
+		void grow() {
+			size_t first = capacity();
+			if (first + chunk_mask + 1 > SlabHandle::INVALID_INDEX) {
+				throw std::runtime_error("Slab is full.");
+			}
+			chunks.push_back(std::make_unique<Slot[]>(chunk_mask + 1));
+			for (size_t i = chunk_mask + 1; i-- > 0;) {
+				chunks.back()[i].next_free = free_head;
+				free_head = static_cast<uint32_t>(first + i);
+			}
+		}
+
+		size_t chunk_shift;
+		size_t chunk_mask;
+		std::vector<std::unique_ptr<Slot[]>> chunks;
+		uint32_t free_head = SlabHandle::INVALID_INDEX;
+		size_t live = 0;
+	};
+} // namespace cpp_socket::base
+
+#endif // SLAB_H
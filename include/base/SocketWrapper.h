@@ -1,6 +1,9 @@
 #ifndef SOCKET_WRAPPER_H
 #define SOCKET_WRAPPER_H
 
+#include <cstring>
+#include <functional>
+#include <utility>
 #include <iostream>
 #include <vector>
 
@@ -16,6 +19,7 @@
 	#define CLOSE_SOCKET closesocket
 	#define POLLFD_TYPE WSAPOLLFD
 	#define POLL WSAPoll
+	#define IOVEC_TYPE WSABUF
 	typedef int socklen_t;
 
 	#define WOULDBLOCK_ERROR  WSAEWOULDBLOCK
@@ -37,10 +41,14 @@
 	#include <errno.h>
 	#include <linux/rtnetlink.h>
     #include <sys/un.h>
+	#include <sys/uio.h>
+	#include "Timestamping.h"
+	#include "BusyPoll.h"
 	#define SOCKET_TYPE int
 	#define CLOSE_SOCKET close
 	#define POLLFD_TYPE pollfd
 	#define POLL poll
+	#define IOVEC_TYPE iovec
 	#define SSIZE_T ssize_t
 	#define SOCKET_ERROR -1
 	#define INVALID_SOCKET -1
@@ -92,6 +100,21 @@ namespace cpp_socket::base
 			}
 		}
 
+		Address(const sockaddr_storage& p_sockaddr, address_family_t address_family) {
+			this->address_family = address_family;
+			m_connect_status = 1;
+			switch (address_family) {
+				case IPV4:
+					m_sockaddr.ipv4 = *(reinterpret_cast<const sockaddr_in*>(&p_sockaddr));
+					break;
+				case IPV6:
+					m_sockaddr.ipv6 = *(reinterpret_cast<const sockaddr_in6*>(&p_sockaddr));
+					break;
+				default:
+					throw std::runtime_error("Unsupported address family.");
+			}
+		}
+
 		/**
 		 * @brief Set the address for given address family
 		 * For netlink, address is unused since it is set to be assigned by the kernel
@@ -237,6 +260,11 @@ namespace cpp_socket::base
 			return address_family;
 		}
 
+		// bind without listening or connecting, for datagram sockets bound to a specific address
+		void set_bind_only() {
+			m_connect_status = -1;
+		}
+
 	private:
 		address_family_t address_family;
 		union {
@@ -298,49 +326,65 @@ namespace cpp_socket::base
 			#endif
 		}
 		
-		SocketWrapper(address_family_t address_family, int type, int protocol, Address address, bool blocking) {
+		/*
+		- configure: optional, called with the new socket before it is bound or connected,
+		  for options that have to be set early (e.g. buffer sizes affect the window scale).
+		*/
+		SocketWrapper(address_family_t address_family, int type, int protocol, Address address, bool blocking,
+			const std::function<void(SOCKET_TYPE)>& configure = nullptr) {
 			if ((m_socket = socket(address_family, type, protocol)) == -1)
 			{
 				throw std::runtime_error("Failed to create socket.");
 			}
 
-			this->blocking = blocking;
+			// the destructor does not run for a constructor that throws, the descriptor is closed here
+			try {
+				this->blocking = blocking;
 
-			if (!blocking) {
-				#ifdef _WIN32
-				u_long nonBlockingMode = 1;
-				if (ioctlsocket(m_socket, FIONBIO, &nonBlockingMode) == SOCKET_ERROR) {
-					throw std::runtime_error("Failed to set non-blocking mode.");
-				}
-				#else
-					int flags = fcntl(m_socket, F_GETFL, 0);
-					if (flags == -1) {
-						throw std::runtime_error("Failed to get socket flags.");
-					}
-					if (fcntl(m_socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+				if (!blocking) {
+					#ifdef _WIN32
+					u_long nonBlockingMode = 1;
+					if (ioctlsocket(m_socket, FIONBIO, &nonBlockingMode) == SOCKET_ERROR) {
 						throw std::runtime_error("Failed to set non-blocking mode.");
 					}
-				#endif
-			}
+					#else
+						int flags = fcntl(m_socket, F_GETFL, 0);
+						if (flags == -1) {
+							throw std::runtime_error("Failed to get socket flags.");
+						}
+						if (fcntl(m_socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+							throw std::runtime_error("Failed to set non-blocking mode.");
+						}
+					#endif
+				}
 
-			this->address = address;
-			int connect_status = address.connect_status();
+				if (configure) {
+					configure(m_socket);
+				}
+
+				this->address = address;
+				int connect_status = address.connect_status();
 			
-			switch (connect_status) {
-				case -2:
-					throw std::runtime_error("Address initialization is wrong.");
-				case -1:
-					m_bind();
-					break;
-				case 0:
-					m_bind();
-					m_listen();
-					break;
-				case 1:
-					m_connect();
-					break;
-				default:
-					throw std::runtime_error("Unrecognized connect status.");
+				switch (connect_status) {
+					case -2:
+						throw std::runtime_error("Address initialization is wrong.");
+					case -1:
+						m_bind();
+						break;
+					case 0:
+						m_bind();
+						m_listen();
+						break;
+					case 1:
+						m_connect();
+						break;
+					default:
+						throw std::runtime_error("Unrecognized connect status.");
+				}
+			}
+			catch (...) {
+				CLOSE_SOCKET(m_socket);
+				throw;
 			}
 		}
 
@@ -348,29 +392,109 @@ namespace cpp_socket::base
 			this->m_socket = m_socket;
 			this->address = std::move(address);
 			this->blocking = blocking;
+			this->connected = true;
+		}
+
+		/*
+		A wrapper owns its descriptor and closes it when destroyed, so it can be moved but
+		not copied. The moved-from wrapper holds INVALID_SOCKET and closes nothing.
+		*/
+		SocketWrapper(const SocketWrapper&) = delete;
+		SocketWrapper& operator=(const SocketWrapper&) = delete;
+
+		SocketWrapper(SocketWrapper&& other) noexcept
+			:m_socket(std::exchange(other.m_socket, INVALID_SOCKET)), address(other.address),
+			blocking(other.blocking), connected(std::exchange(other.connected, false)) {
+
+		}
+
+		SocketWrapper& operator=(SocketWrapper&& other) noexcept {
+			if (this != &other) {
+				end();
+				m_socket = std::exchange(other.m_socket, INVALID_SOCKET);
+				address = other.address;
+				blocking = other.blocking;
+				connected = std::exchange(other.connected, false);
+			}
+			return *this;
 		}
 		
-		SocketWrapper* accept_connection()
+		SocketWrapper accept_connection()
 		{
-			SOCKET_TYPE clientSocket;
-			sockaddr client_sockaddr;
-			socklen_t client_sockaddr_size = sizeof(client_sockaddr);
-
-			clientSocket = accept(m_socket, reinterpret_cast<struct sockaddr *>(&client_sockaddr), &client_sockaddr_size);
+			Address clientAddress;
+			SOCKET_TYPE clientSocket = accept_socket(clientAddress);
 
 			if (clientSocket == INVALID_SOCKET) {
 				throw std::runtime_error("Error accepting client.");
 			}
 
-			Address clientAddress(client_sockaddr, address.get_address_family());
-
-			return new SocketWrapper(clientSocket, std::move(clientAddress), blocking);
+			return SocketWrapper(clientSocket, std::move(clientAddress), blocking);
 		}
 
 		SOCKET_TYPE get_socket() {
 			return m_socket;
 		}
 
+		/*
+		Completes a connect started by the constructor on a non-blocking socket.
+		Safe to call repeatedly, e.g. whenever polling reports POLLOUT.
+		- Returns -1 if the connect failed, get_syscall_error() returns the reason.
+		- Returns 0 if the connect is still in progress.
+		- Returns 1 if the connection is established.
+		*/
+		int finish_connect() {
+			if (connected) {
+				return 1;
+			}
+
+			POLLFD_TYPE pfd;
+			pfd.fd = m_socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+
+			int r = POLL(&pfd, 1, 0);
+			if (r == SOCKET_ERROR) {
+				return -1;
+			}
+			else if (r == 0) {
+				return 0;
+			}
+
+			int err = get_socket_error();
+			if (err == SOCKET_ERROR) {
+				return -1;
+			}
+			else if (err != 0) {
+				#ifdef _WIN32
+					WSASetLastError(err);
+				#else
+					errno = err;
+				#endif
+				return -1;
+			}
+
+			connected = true;
+			return 1;
+		}
+
+		bool is_connected() {
+			return connected;
+		}
+
+		/*
+		- Returns the pending error of the socket (SO_ERROR) and clears it.
+		- Returns SOCKET_ERROR if the error could not be read, get_syscall_error() returns
+		  the reason. Socket errors are positive, so the two cannot be confused.
+		*/
+		int get_socket_error() {
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if (getsockopt(m_socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) == SOCKET_ERROR) {
+				return SOCKET_ERROR;
+			}
+			return err;
+		}
+
         #ifdef __unix__
         /**
          * @brief Set to receive outgoing frames from a layer 2 socket
@@ -391,13 +515,198 @@ namespace cpp_socket::base
 			return send(m_socket, buf, len, flags);
 		}
 
+		/*
+		Gathers count buffers into a single send call.
+		- Returns the number of bytes sent, which may end in the middle of any buffer.
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int send_iovec_wrapper(IOVEC_TYPE* iov, int count, int flags) {
+			#ifdef _WIN32
+				DWORD sent = 0;
+				if (WSASend(m_socket, iov, count, &sent, flags, NULL, NULL) == SOCKET_ERROR) {
+					return SOCKET_ERROR;
+				}
+				return static_cast<int>(sent);
+			#else
+				msghdr msg{};
+				msg.msg_iov = iov;
+				msg.msg_iovlen = count;
+				return sendmsg(m_socket, &msg, flags);
+			#endif
+		}
+
+		/*
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int set_socket_option(int level, int name, int value) {
+			return setsockopt(m_socket, level, name, reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		static void set_iovec(IOVEC_TYPE& iov, const void* buf, size_t len) {
+			#ifdef _WIN32
+				iov.buf = reinterpret_cast<CHAR*>(const_cast<void*>(buf));
+				iov.len = static_cast<ULONG>(len);
+			#else
+				iov.iov_base = const_cast<void*>(buf);
+				iov.iov_len = len;
+			#endif
+		}
+
 		int receive_wrapper(char *buf, int len, int flags) {
 			return recv(m_socket, buf, len, flags);
 		}
 
+		#ifdef __unix__
+		/*
+		Enables kernel (and hardware) packet timestamping.
+		- flags: timestamping_t values combined with |.
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int enable_timestamping(int flags) {
+			return setsockopt(m_socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+		}
+
+		/*
+		Kernel busy polling: a receive call on an empty socket polls the device queue
+		for up to usecs instead of waiting for the interrupt. Values above
+		net.core.busy_read need CAP_NET_ADMIN.
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int set_busy_poll(int usecs) {
+			return setsockopt(m_socket, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+		}
+
+		/*
+		Keeps the device interrupts deferred while the application polls, so packets are
+		only picked up by busy polling (needs napi_defer_hard_irqs/gro_flush_timeout set on the device).
+		*/
+		int set_prefer_busy_poll(bool prefer) {
+			int flag = prefer ? 1 : 0;
+			return setsockopt(m_socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &flag, sizeof(flag));
+		}
+
+		// packets processed per busy poll pass, above the default of 8 needs CAP_NET_ADMIN
+		int set_busy_poll_budget(int budget) {
+			return setsockopt(m_socket, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget));
+		}
+
+		/*
+		Spin-then-block wait: peeks with MSG_DONTWAIT for up to spin_ns (each call busy polls
+		the device with set_busy_poll), then blocks in poll. Use it before a receive function
+		that reads on its own, e.g. TcpSocket::receive.
+		- timeout_ms: limit for the blocking part, -1 for none.
+		- stats: optional, counts whether the spin found data.
+		- Returns 1 if data, EOF or an error is pending (the next receive reports it), 0 on timeout,
+		  SOCKET_ERROR on syscall error.
+		*/
+		int wait_readable(int64_t spin_ns, int timeout_ms = -1, SpinStats* stats = nullptr) {
+			char byte;
+			int64_t deadline = monotonic_ns() + spin_ns;
+			do {
+				if (recv(m_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 || errno != WOULDBLOCK_ERROR) {
+					if (stats != nullptr) {
+						stats->spin_hits++;
+					}
+					return 1;
+				}
+			} while (monotonic_ns() < deadline);
+			if (stats != nullptr) {
+				stats->sleeps++;
+			}
+			pollfd pfd{m_socket, POLLIN, 0};
+			int r = poll(&pfd, 1, timeout_ms);
+			return r > 0 ? 1 : r;
+		}
+
+		/*
+		receive_wrapper that spins for up to spin_ns with MSG_DONTWAIT before blocking.
+		- Returns the same as receive_wrapper, SOCKET_ERROR with WOULDBLOCK_ERROR on a
+		  non-blocking socket if nothing arrived while spinning.
+		*/
+		int receive_spin(char *buf, int len, int flags, int64_t spin_ns, SpinStats* stats = nullptr) {
+			int64_t deadline = monotonic_ns() + spin_ns;
+			do {
+				int r = recv(m_socket, buf, len, flags | MSG_DONTWAIT);
+				if (r >= 0 || errno != WOULDBLOCK_ERROR) {
+					if (stats != nullptr) {
+						stats->spin_hits++;
+					}
+					return r;
+				}
+			} while (monotonic_ns() < deadline);
+			if (stats != nullptr) {
+				stats->sleeps++;
+			}
+			return recv(m_socket, buf, len, flags);
+		}
+
+		/*
+		recv that also returns the RX timestamps of the received data.
+		Timestamps are left untouched if the kernel did not report any,
+		so a frame received in several calls keeps the latest ones.
+		- Returns the same as receive_wrapper.
+		*/
+		int receive_timestamped(char *buf, int len, int flags, PacketTimestamps& timestamps) {
+			iovec iov;
+			set_iovec(iov, buf, len);
+			alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+			msghdr msg{};
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+
+			int r = recvmsg(m_socket, &msg, flags);
+			if (r < 0) {
+				return r;
+			}
+			for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+				if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING) {
+					timestamps.set(*reinterpret_cast<scm_timestamping*>(CMSG_DATA(cm)));
+				}
+			}
+			return r;
+		}
+
+		/*
+		Reads one notification (TX timestamp, zerocopy completion, ...) from the error queue.
+		Pending notifications are signalled by POLLERR.
+		- Returns -1 if there is syscall error, WOULDBLOCK_ERROR if the queue is empty.
+		- Returns 1 if entry is filled.
+		*/
+		int receive_error_queue(ErrorQueueEntry& entry) {
+			alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+			msghdr msg{};
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+
+			if (recvmsg(m_socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == SOCKET_ERROR) {
+				return -1;
+			}
+
+			entry = ErrorQueueEntry();
+			for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+				if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING) {
+					entry.timestamps.set(*reinterpret_cast<scm_timestamping*>(CMSG_DATA(cm)));
+				}
+				else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+					(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR) ||
+					(cm->cmsg_level == SOL_PACKET && cm->cmsg_type == PACKET_TX_TIMESTAMP)) {
+					memcpy(&entry.err, CMSG_DATA(cm), sizeof(entry.err));
+					entry.has_err = true;
+				}
+			}
+			return 1;
+		}
+		#endif
+
+		// closes the descriptor, safe to call more than once
 		void end()
 		{
-			CLOSE_SOCKET(m_socket);
+			if (m_socket != INVALID_SOCKET) {
+				CLOSE_SOCKET(m_socket);
+				m_socket = INVALID_SOCKET;
+			}
 		}
 
 		static void cleanup()
@@ -412,9 +721,35 @@ namespace cpp_socket::base
 			end();
 		}
 	protected:
+		/*
+		accept() wrapper, the accepted socket gets the blocking mode of the listening socket.
+		- Returns INVALID_SOCKET on syscall error, WOULDBLOCK_ERROR if nothing is pending.
+		*/
+		SOCKET_TYPE accept_socket(Address& client_address) {
+			sockaddr_storage client_sockaddr;
+			socklen_t client_sockaddr_size = sizeof(client_sockaddr);
+
+			#ifdef _WIN32
+				SOCKET_TYPE clientSocket = accept(m_socket, reinterpret_cast<sockaddr*>(&client_sockaddr), &client_sockaddr_size);
+				u_long nonBlockingMode = 1;
+				if (clientSocket != INVALID_SOCKET && !blocking && ioctlsocket(clientSocket, FIONBIO, &nonBlockingMode) == SOCKET_ERROR) {
+					CLOSE_SOCKET(clientSocket);
+					return INVALID_SOCKET;
+				}
+			#else
+				SOCKET_TYPE clientSocket = accept4(m_socket, reinterpret_cast<sockaddr*>(&client_sockaddr), &client_sockaddr_size, blocking ? 0 : SOCK_NONBLOCK);
+			#endif
+
+			if (clientSocket != INVALID_SOCKET) {
+				client_address = Address(client_sockaddr, address.get_address_family());
+			}
+			return clientSocket;
+		}
+
 		SOCKET_TYPE m_socket;
 		Address address;
 		bool blocking;
+		bool connected = false;
 	private:
 		void m_bind() {
 			if (bind(m_socket, address.get_sockaddr(), address.size()) == -1)
@@ -443,10 +778,13 @@ namespace cpp_socket::base
 					throw std::runtime_error("Failed to connect to server.");
 				}
 			}
+			else {
+				connected = true;
+			}
 		}
 
 		void m_listen() {
-			if (listen(m_socket, 1) == -1)
+			if (listen(m_socket, SOMAXCONN) == -1)
 			{
 				throw std::runtime_error("Failed to listen.");
 			}
@@ -0,0 +1,76 @@
+#ifndef TIMER_FD_H
+#define TIMER_FD_H
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::base {
+	/*
+	Non-blocking CLOCK_MONOTONIC timerfd, for deadlines finer than the millisecond
+	ticks of TimerWheel and the epoll_wait timeout. Register get_fd() for EPOLLIN,
+	it becomes readable once the armed deadline has passed.
+	*/
+	class TimerFd {
+		using clock = std::chrono::steady_clock;
+	public:
+		TimerFd() {
+			if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+				throw std::runtime_error("Failed to create timerfd.");
+			}
+		}
+
+		TimerFd(const TimerFd&) = delete;
+		TimerFd& operator=(const TimerFd&) = delete;
+
+		~TimerFd() {
+			close(fd);
+		}
+
+		int get_fd() {
+			return fd;
+		}
+
+		/*
+		Arms the timer for deadline, replacing the previous one. steady_clock is
+		CLOCK_MONOTONIC on Linux, a deadline in the past fires right away.
+		- Returns -1 on syscall error.
+		*/
+		int arm(clock::time_point deadline) {
+			auto since_boot = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+			// an all zero value would disarm the timer
+			since_boot = since_boot > 0 ? since_boot : 1;
+			itimerspec spec{};
+			spec.it_value.tv_sec = since_boot / 1000000000;
+			spec.it_value.tv_nsec = since_boot % 1000000000;
+			return timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+		}
+
+		int disarm() {
+			itimerspec spec{};
+			return timerfd_settime(fd, 0, &spec, nullptr);
+		}
+
+		/*
+		Resets the readiness.
+		- Returns the number of expirations since the last drain.
+		*/
+		uint64_t drain() {
+			uint64_t value = 0;
+			if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+				return 0;
+			}
+			return value;
+		}
+	private:
+		int fd;
+	};
+} // namespace cpp_socket::base
+
+#endif // TIMER_FD_H
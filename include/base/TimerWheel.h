@@ -0,0 +1,332 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+namespace cpp_socket::base {
+	/*
+	Hierarchical timer wheel: 4 levels of 256 slots, level 0 holds the timers of the
+	current 256 ticks and every level above covers 256 times the span of the one below.
+	Arming, cancelling and firing a timer are O(1), timers are intrusive so arming
+	never allocates, and a slot of a higher level is only cascaded down once the wheel
+	reaches it. Not thread safe, a wheel is driven by the thread of its event loop.
+	*/
+	class TimerWheel {
+		using clock = std::chrono::steady_clock;
+	public:
+		/*
+		Embed it in the object it times out (e.g. a connection), it is cancelled when destroyed.
+		*/
+		class Timer {
+		public:
+			Timer() = default;
+
+			explicit Timer(std::function<void()> callback)
+				:callback(std::move(callback)) {
+
+			}
+
+			Timer(const Timer&) = delete;
+			Timer& operator=(const Timer&) = delete;
+
+			~Timer() {
+				if (wheel != nullptr) {
+					wheel->cancel(*this);
+				}
+			}
+
+			void set_callback(std::function<void()> callback) {
+				this->callback = std::move(callback);
+			}
+
+			bool is_armed() const {
+				return wheel != nullptr;
+			}
+		private:
+			friend class TimerWheel;
+
+			std::function<void()> callback;
+			TimerWheel* wheel = nullptr;
+			Timer* previous = nullptr;
+			Timer* next = nullptr;
+			// tick the timer is due, may be later than the slot it sits in
+			uint64_t expiry = 0;
+			uint64_t period = 0;
+			unsigned char level = 0;
+			unsigned char slot = 0;
+		};
+
+		static constexpr int LEVELS = 4;
+		static constexpr int SLOT_BITS = 8;
+		static constexpr int SLOTS = 1 << SLOT_BITS;
+
+		explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(1))
+			:tick(std::max(tick, std::chrono::milliseconds(1))), start(clock::now()) {
+
+		}
+
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel& operator=(const TimerWheel&) = delete;
+
+		~TimerWheel() {
+			for (int level = 0; level < LEVELS; level++) {
+				for (int slot = 0; slot < SLOTS; slot++) {
+					while (slots[level][slot] != nullptr) {
+						unlink(*slots[level][slot]);
+					}
+				}
+			}
+		}
+
+		/*
+		Arms the timer to fire once after delay, rounded up to the tick. An armed timer is re-armed.
+		*/
+		void schedule(Timer& timer, std::chrono::milliseconds delay) {
+			if (timer.wheel != nullptr) {
+				unlink(timer);
+			}
+			timer.period = 0;
+			timer.expiry = deadline(delay);
+			link(timer);
+		}
+
+		/*
+		Arms the timer to fire every interval until cancelled.
+		*/
+		void schedule_periodic(Timer& timer, std::chrono::milliseconds interval) {
+			schedule(timer, interval);
+			timer.period = std::max<uint64_t>(ticks(interval), 1);
+		}
+
+		/*
+		Pushes the expiry of an armed timer back without touching the wheel, the timer
+		is moved when its old slot comes up. Meant for idle timeouts refreshed on every I/O.
+		Arms the timer if it is not armed or the new expiry is earlier.
+		*/
+		void extend(Timer& timer, std::chrono::milliseconds delay) {
+			uint64_t expiry = deadline(delay);
+			if (timer.wheel == nullptr || expiry < timer.expiry) {
+				schedule(timer, delay);
+				return;
+			}
+			timer.expiry = expiry;
+		}
+
+		void cancel(Timer& timer) {
+			if (timer.wheel != nullptr) {
+				unlink(timer);
+			}
+		}
+
+		/*
+		Fires all timers due by now, callbacks may arm and cancel any timer.
+		- Returns the number of timers fired.
+		*/
+		int advance() {
+			uint64_t target = current_tick();
+			int fired = 0;
+			while (now < target && armed > 0) {
+				// skip the ticks without timers or cascades
+				uint64_t next = std::min(next_expiry(), target);
+				now = std::max(next, now + 1);
+				cascade();
+				fired += expire();
+			}
+			now = std::max(now, target);
+			return fired;
+		}
+
+		/*
+		Time until the next timer is due, meant as epoll_wait timeout.
+		- Returns -1 if no timer is armed.
+		*/
+		int timeout_ms() {
+			if (armed == 0) {
+				return -1;
+			}
+			uint64_t next = next_expiry();
+			clock::duration until = start + tick * next - clock::now();
+			if (until <= clock::duration::zero()) {
+				return 0;
+			}
+			// round up, waking early only costs an empty iteration
+			auto ms = std::chrono::ceil<std::chrono::milliseconds>(until).count();
+			return static_cast<int>(std::min<int64_t>(ms, std::numeric_limits<int>::max()));
+		}
+
+		size_t size() {
+			return armed;
+		}
+	private:
+		static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+		static constexpr unsigned char EXPIRING = LEVELS;
+		static constexpr int BITMAP_WORDS = SLOTS / 64;
+
+		uint64_t current_tick() {
+			return (clock::now() - start) / tick;
+		}
+
+		uint64_t ticks(std::chrono::milliseconds delay) {
+			if (delay <= std::chrono::milliseconds::zero()) {
+				return 0;
+			}
+			return (delay + tick - std::chrono::milliseconds(1)) / tick;
+		}
+
+		// rounded up so a timer never fires early, and at least one tick ahead of the last processed tick
+		uint64_t deadline(std::chrono::milliseconds delay) {
+			clock::duration at = clock::now() - start + std::max(delay, std::chrono::milliseconds(0));
+			uint64_t expiry = (at + tick - clock::duration(1)) / tick;
+			return std::max(expiry, now + 1);
+		}
+
+		/*
+		Positions are relative to the next tick to process. A timer goes to the lowest level
+		whose current span contains its expiry, expiries beyond the span of the top level
+		are parked at its end and re-inserted from there.
+		*/
+		void link(Timer& timer) {
+			uint64_t base = now + 1;
+			uint64_t horizon = base | ((uint64_t(1) << (SLOT_BITS * LEVELS)) - 1);
+			uint64_t expiry = std::min(timer.expiry, horizon);
+			int level = 0;
+			while (level < LEVELS - 1 && (expiry >> (SLOT_BITS * (level + 1))) != (base >> (SLOT_BITS * (level + 1)))) {
+				level++;
+			}
+			int slot = (expiry >> (SLOT_BITS * level)) & SLOT_MASK;
+
+			timer.level = static_cast<unsigned char>(level);
+			timer.slot = static_cast<unsigned char>(slot);
+			push(timer, slots[level][slot]);
+			occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+		}
+
+		void push(Timer& timer, Timer*& head) {
+			timer.wheel = this;
+			timer.previous = nullptr;
+			timer.next = head;
+			if (timer.next != nullptr) {
+				timer.next->previous = &timer;
+			}
+			head = &timer;
+			armed++;
+		}
+
+		void unlink(Timer& timer) {
+			if (timer.previous != nullptr) {
+				timer.previous->next = timer.next;
+			}
+			else if (timer.level == EXPIRING) {
+				expiring = timer.next;
+			}
+			else {
+				slots[timer.level][timer.slot] = timer.next;
+				if (timer.next == nullptr) {
+					occupied[timer.level][timer.slot / 64] &= ~(uint64_t(1) << (timer.slot % 64));
+				}
+			}
+			if (timer.next != nullptr) {
+				timer.next->previous = timer.previous;
+			}
+			timer.wheel = nullptr;
+			timer.previous = nullptr;
+			timer.next = nullptr;
+			armed--;
+		}
+
+		// first occupied slot at or after position, -1 if none
+		int next_occupied(int level, int position) {
+			int slot = position;
+			while (slot < SLOTS) {
+				uint64_t word = occupied[level][slot / 64] >> (slot % 64);
+				if (word != 0) {
+					return slot + std::countr_zero(word);
+				}
+				slot = (slot / 64 + 1) * 64;
+			}
+			return -1;
+		}
+
+		/*
+		The first occupied slot of a level is the earliest tick that level has timers to
+		fire or to cascade. A higher level can come first when the next tick starts the
+		span its slot covers.
+		*/
+		uint64_t next_expiry() {
+			uint64_t base = now + 1;
+			uint64_t next = std::numeric_limits<uint64_t>::max();
+			for (int level = 0; level < LEVELS; level++) {
+				int shift = SLOT_BITS * level;
+				int slot = next_occupied(level, (base >> shift) & SLOT_MASK);
+				if (slot >= 0) {
+					uint64_t span = uint64_t(1) << (shift + SLOT_BITS);
+					next = std::min(next, (base & ~(span - 1)) | (uint64_t(slot) << shift));
+				}
+			}
+			return next;
+		}
+
+		// entering a new span of a level moves the timers of its slot one level down, top level first
+		void cascade() {
+			int top = 0;
+			while (top < LEVELS - 1 && (now & ((uint64_t(1) << (SLOT_BITS * (top + 1))) - 1)) == 0) {
+				top++;
+			}
+			for (int level = top; level >= 1; level--) {
+				int slot = (now >> (SLOT_BITS * level)) & SLOT_MASK;
+				Timer* timer;
+				while ((timer = slots[level][slot]) != nullptr) {
+					unlink(*timer);
+					link(*timer);
+				}
+			}
+		}
+
+		/*
+		The slot is moved to the expiring list first, timers re-armed by callbacks may land
+		in the same slot again for the next round.
+		*/
+		int expire() {
+			int fired = 0;
+			int slot = now & SLOT_MASK;
+			Timer* timer;
+			while ((timer = slots[0][slot]) != nullptr) {
+				unlink(*timer);
+				timer->level = EXPIRING;
+				push(*timer, expiring);
+			}
+			while ((timer = expiring) != nullptr) {
+				unlink(*timer);
+				if (timer->expiry > now) {
+					// extended or parked beyond the top level
+					link(*timer);
+					continue;
+				}
+				if (timer->period > 0) {
+					timer->expiry = std::max(timer->expiry + timer->period, now + 1);
+					link(*timer);
+				}
+				fired++;
+				timer->callback();
+			}
+			return fired;
+		}
+
+		clock::duration tick;
+		clock::time_point start;
+		// last tick processed
+		uint64_t now = 0;
+		size_t armed = 0;
+		Timer* slots[LEVELS][SLOTS] = {};
+		uint64_t occupied[LEVELS][BITMAP_WORDS] = {};
+		// timers of the slot being fired
+		Timer* expiring = nullptr;
+	};
+} // namespace cpp_socket::base
+
+#endif // TIMER_WHEEL_H
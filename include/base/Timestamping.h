@@ -0,0 +1,91 @@
+#ifndef TIMESTAMPING_H
+#define TIMESTAMPING_H
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+// linux/errqueue.h uses struct timespec without including it
+#include <ctime>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <cstdint>
+
+namespace cpp_socket::base {
+	/*
+	Flags for SocketWrapper::enable_timestamping, combine them with |.
+	TX timestamps are reported on the error queue without the packet (OPT_TSONLY),
+	keyed by a per socket counter (OPT_ID), see SocketWrapper::receive_error_queue.
+	Hardware timestamps also need the NIC to be configured, see RawSocket::enable_hardware_timestamping.
+	*/
+	enum timestamping_t {
+		RX_SOFTWARE_TIMESTAMPS = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE,
+		RX_HARDWARE_TIMESTAMPS = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE,
+		TX_SOFTWARE_TIMESTAMPS = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+			| SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY,
+		TX_HARDWARE_TIMESTAMPS = SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+			| SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY
+	};
+
+	/*
+	Software timestamps are CLOCK_REALTIME, hardware timestamps are in the NIC clock,
+	which is only comparable to the system clock if it is synchronized (e.g. phc2sys).
+	*/
+	struct PacketTimestamps {
+		timespec software{};
+		timespec hardware{};
+		bool has_software = false;
+		bool has_hardware = false;
+
+		static int64_t to_ns(const timespec& ts) {
+			return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+		}
+
+		static int64_t now_ns() {
+			timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			return to_ns(now);
+		}
+
+		/*
+		Takes the timestamps out of an SCM_TIMESTAMPING control message.
+		*/
+		void set(const scm_timestamping& tss) {
+			if (tss.ts[0].tv_sec != 0 || tss.ts[0].tv_nsec != 0) {
+				software = tss.ts[0];
+				has_software = true;
+			}
+			if (tss.ts[2].tv_sec != 0 || tss.ts[2].tv_nsec != 0) {
+				hardware = tss.ts[2];
+				has_hardware = true;
+			}
+		}
+
+		// nanoseconds since the kernel timestamped the packet, -1 if there is no software timestamp
+		int64_t software_age_ns() const {
+			return has_software ? now_ns() - to_ns(software) : -1;
+		}
+
+		// nanoseconds between the NIC and the kernel timestamp, -1 unless both are available
+		int64_t hardware_to_software_ns() const {
+			return has_software && has_hardware ? to_ns(software) - to_ns(hardware) : -1;
+		}
+	};
+
+	/*
+	One notification read from a socket error queue, either a TX timestamp
+	(err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING, err.ee_data is the OPT_ID key)
+	or another extended error such as a zerocopy completion.
+	*/
+	struct ErrorQueueEntry {
+		sock_extended_err err{};
+		bool has_err = false;
+		PacketTimestamps timestamps;
+
+		bool is_tx_timestamp() const {
+			return has_err && err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING;
+		}
+	};
+} // namespace cpp_socket::base
+
+#endif // TIMESTAMPING_H
@@ -0,0 +1,234 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace cpp_socket::base {
+	/*
+	Thread pool where every worker has its own task queue and idle workers steal
+	from the others, so CPU heavy tasks spread over all cores without a single
+	contended queue. Tasks that have to run in order (e.g. the messages of one
+	connection) go through a Strand.
+	*/
+	class WorkStealingPool {
+	public:
+		using task_t = std::function<void()>;
+
+		/*
+		Serializes its tasks: they run one at a time in the order they were posted,
+		on whichever worker is free, so ordering is kept while different strands
+		run in parallel.
+		*/
+		class Strand: public std::enable_shared_from_this<Strand> {
+		public:
+			Strand(const Strand&) = delete;
+			Strand& operator=(const Strand&) = delete;
+
+			// safe to call from any thread, a scheduled strand keeps itself alive until it runs dry
+			void post(task_t task) {
+				{
+					std::lock_guard lock(mutex);
+					tasks.push_back(std::move(task));
+					if (scheduled) {
+						return;
+					}
+					scheduled = true;
+				}
+				pool.submit([self = this->shared_from_this()] { self->run(); });
+			}
+
+			bool is_idle() {
+				std::lock_guard lock(mutex);
+				return !scheduled;
+			}
+		private:
+			friend class WorkStealingPool;
+
+			explicit Strand(WorkStealingPool& pool)
+				:pool(pool) {
+
+			}
+
+			// a strand with a long backlog yields its worker after this many tasks
+			static constexpr int MAX_TASKS_PER_RUN = 16;
+
+			void run() {
+				for (int i = 0; i < MAX_TASKS_PER_RUN; i++) {
+					task_t task;
+					{
+						std::lock_guard lock(mutex);
+						if (tasks.empty()) {
+							scheduled = false;
+							return;
+						}
+						task = std::move(tasks.front());
+						tasks.pop_front();
+					}
+					task();
+				}
+				{
+					std::lock_guard lock(mutex);
+					if (tasks.empty()) {
+						scheduled = false;
+						return;
+					}
+				}
+				pool.submit([self = this->shared_from_this()] { self->run(); });
+			}
+
+			WorkStealingPool& pool;
+			std::mutex mutex;
+			std::deque<task_t> tasks;
+			bool scheduled = false;
+		};
+
+		explicit WorkStealingPool(size_t threads = std::thread::hardware_concurrency()) {
+			if (threads == 0) {
+				throw std::runtime_error("At least one thread is required.");
+			}
+			for (size_t i = 0; i < threads; i++) {
+				queues.push_back(std::make_unique<WorkerQueue>());
+			}
+			for (size_t i = 0; i < threads; i++) {
+				workers.emplace_back([this, i] { work(i); });
+			}
+		}
+
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+		// runs the queued tasks before returning
+		~WorkStealingPool() {
+			{
+				std::lock_guard lock(sleep_mutex);
+				stopping = true;
+			}
+			wakeup.notify_all();
+			for (std::thread& worker: workers) {
+				worker.join();
+			}
+		}
+
+		/*
+		Safe to call from any thread. Tasks submitted from a worker go to its own queue,
+		others are spread round robin.
+		*/
+		void submit(task_t task) {
+			size_t index;
+			if (current_pool == this) {
+				index = current_index;
+			}
+			else {
+				index = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+			}
+			{
+				std::lock_guard lock(queues[index]->mutex);
+				queues[index]->tasks.push_back(std::move(task));
+			}
+			queued.fetch_add(1);
+			if (sleepers.load() > 0) {
+				std::lock_guard lock(sleep_mutex);
+				wakeup.notify_one();
+			}
+		}
+
+		// strands must not outlive the pool
+		std::shared_ptr<Strand> make_strand() {
+			return std::shared_ptr<Strand>(new Strand(*this));
+		}
+
+		size_t thread_count() {
+			return workers.size();
+		}
+
+		// number of tasks run by a worker other than the one they were queued on
+		uint64_t stolen_count() {
+			return stolen.load(std::memory_order_relaxed);
+		}
+
+		uint64_t executed_count() {
+			return executed.load(std::memory_order_relaxed);
+		}
+	private:
+		struct alignas(64) WorkerQueue {
+			std::mutex mutex;
+			std::deque<task_t> tasks;
+		};
+
+		void work(size_t index) {
+			current_pool = this;
+			current_index = index;
+			while (true) {
+				task_t task;
+				if (pop(index, task) || steal(index, task)) {
+					queued.fetch_sub(1);
+					task();
+					executed.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+
+				std::unique_lock lock(sleep_mutex);
+				if (stopping && queued.load() == 0) {
+					return;
+				}
+				sleepers.fetch_add(1);
+				wakeup.wait(lock, [this] { return queued.load() > 0 || stopping; });
+				sleepers.fetch_sub(1);
+			}
+		}
+
+		// the owner takes the oldest task, so a strand re-submitting itself cannot starve the others
+		bool pop(size_t index, task_t& task) {
+			WorkerQueue& queue = *queues[index];
+			std::lock_guard lock(queue.mutex);
+			if (queue.tasks.empty()) {
+				return false;
+			}
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+
+		// thieves take the newest task from the other end to stay out of the owner's way
+		bool steal(size_t index, task_t& task) {
+			for (size_t i = 1; i < queues.size(); i++) {
+				WorkerQueue& victim = *queues[(index + i) % queues.size()];
+				std::unique_lock lock(victim.mutex, std::try_to_lock);
+				if (!lock.owns_lock() || victim.tasks.empty()) {
+					continue;
+				}
+				task = std::move(victim.tasks.back());
+				victim.tasks.pop_back();
+				stolen.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+			return false;
+		}
+
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<size_t> next_queue = 0;
+		std::atomic<size_t> queued = 0;
+
+		std::mutex sleep_mutex;
+		std::condition_variable wakeup;
+		std::atomic<int> sleepers = 0;
+		bool stopping = false;
+
+		std::atomic<uint64_t> stolen = 0;
+		std::atomic<uint64_t> executed = 0;
+
+		static inline thread_local WorkStealingPool* current_pool = nullptr;
+		static inline thread_local size_t current_index = 0;
+	};
+} // namespace cpp_socket::base
+
+#endif // WORK_STEALING_POOL_H
@@ -0,0 +1,172 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define CHECKSUM_X86 1
+#endif
+
+namespace cpp_socket::linklayer {
+	/*
+	Internet checksum (RFC 1071). Sums are kept in memory order: 16 bit words are added
+	as they lie in the buffer and the result is stored back with memcpy, the ones'
+	complement sum gives the same bytes on any endianness. Values from the packet
+	(ports, addresses, ...) passed to the update functions are in memory order too.
+
+	checksum_add picks the widest kernel the CPU supports at runtime: AVX2, SSE2 or
+	a scalar loop over 32 bit words.
+	*/
+	namespace checksum_detail {
+		inline uint64_t add_scalar(const unsigned char* data, size_t size, uint64_t sum) {
+			while (size >= 4) {
+				uint32_t word;
+				memcpy(&word, data, 4);
+				sum += word;
+				data += 4;
+				size -= 4;
+			}
+			if (size >= 2) {
+				uint16_t word;
+				memcpy(&word, data, 2);
+				sum += word;
+				data += 2;
+				size -= 2;
+			}
+			if (size == 1) {
+				// padded with a zero byte
+				sum += std::endian::native == std::endian::little ? data[0] : static_cast<uint64_t>(data[0]) << 8;
+			}
+			return sum;
+		}
+
+		#ifdef CHECKSUM_X86
+		// 32 bit lanes take at least 32768 blocks before they can overflow, flushed well before
+		static constexpr size_t SIMD_FLUSH_BLOCKS = 16384;
+
+		__attribute__((target("avx2")))
+		inline uint64_t add_avx2(const unsigned char* data, size_t size, uint64_t sum) {
+			const __m256i zero = _mm256_setzero_si256();
+			while (size >= 32) {
+				__m256i acc = zero;
+				for (size_t blocks = 0; size >= 32 && blocks < SIMD_FLUSH_BLOCKS; blocks++) {
+					__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+					acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(v, zero), _mm256_unpackhi_epi16(v, zero)));
+					data += 32;
+					size -= 32;
+				}
+				uint32_t lanes[8];
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+				for (uint32_t lane: lanes) {
+					sum += lane;
+				}
+			}
+			return add_scalar(data, size, sum);
+		}
+
+		__attribute__((target("sse2")))
+		inline uint64_t add_sse2(const unsigned char* data, size_t size, uint64_t sum) {
+			const __m128i zero = _mm_setzero_si128();
+			while (size >= 16) {
+				__m128i acc = zero;
+				for (size_t blocks = 0; size >= 16 && blocks < SIMD_FLUSH_BLOCKS; blocks++) {
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+					acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+					data += 16;
+					size -= 16;
+				}
+				uint32_t lanes[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+				for (uint32_t lane: lanes) {
+					sum += lane;
+				}
+			}
+			return add_scalar(data, size, sum);
+		}
+
+		inline bool has_avx2() {
+			static const bool supported = __builtin_cpu_supports("avx2");
+			return supported;
+		}
+
+		inline bool has_sse2() {
+			static const bool supported = __builtin_cpu_supports("sse2");
+			return supported;
+		}
+		#endif
+	} // namespace checksum_detail
+
+	// below this the SIMD setup costs more than it saves, headers are summed with the scalar loop
+	inline constexpr size_t CHECKSUM_SIMD_THRESHOLD = 64;
+
+	/*
+	Adds size bytes to a running sum. Chunks added one after another must have even
+	sizes except the last one, a 64 bit sum never overflows for any packet.
+	*/
+	inline uint64_t checksum_add(const void* data, size_t size, uint64_t sum = 0) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		#ifdef CHECKSUM_X86
+		if (size >= CHECKSUM_SIMD_THRESHOLD) {
+			if (checksum_detail::has_avx2()) {
+				return checksum_detail::add_avx2(bytes, size, sum);
+			}
+			if (checksum_detail::has_sse2()) {
+				return checksum_detail::add_sse2(bytes, size, sum);
+			}
+		}
+		#endif
+		return checksum_detail::add_scalar(bytes, size, sum);
+	}
+
+	// folds a running sum into 16 bits with end around carry, not complemented
+	inline uint16_t checksum_fold(uint64_t sum) {
+		sum = (sum & 0xffffffff) + (sum >> 32);
+		sum = (sum & 0xffffffff) + (sum >> 32);
+		sum = (sum & 0xffff) + (sum >> 16);
+		sum = (sum & 0xffff) + (sum >> 16);
+		return static_cast<uint16_t>(sum);
+	}
+
+	// the checksum field value for the bytes (with the field zeroed), in memory order
+	inline uint16_t checksum_compute(const void* data, size_t size, uint64_t sum = 0) {
+		return static_cast<uint16_t>(~checksum_fold(checksum_add(data, size, sum)));
+	}
+
+	// true if the bytes, checksum field included, sum up to all ones
+	inline bool checksum_verify(const void* data, size_t size, uint64_t sum = 0) {
+		return checksum_fold(checksum_add(data, size, sum)) == 0xffff;
+	}
+
+	/*
+	Incremental update (RFC 1624) of a checksum for a 16 bit field changing from
+	old_value to new_value, eqn. 3: HC' = ~(~HC + ~m + m').
+	*/
+	inline uint16_t checksum_update16(uint16_t checksum, uint16_t old_value, uint16_t new_value) {
+		uint64_t sum = static_cast<uint16_t>(~checksum);
+		sum += static_cast<uint16_t>(~old_value);
+		sum += new_value;
+		return static_cast<uint16_t>(~checksum_fold(sum));
+	}
+
+	// same for a 32 bit field, e.g. an IPv4 address
+	inline uint16_t checksum_update32(uint16_t checksum, uint32_t old_value, uint32_t new_value) {
+		uint64_t sum = static_cast<uint16_t>(~checksum);
+		sum += static_cast<uint32_t>(~old_value);
+		sum += new_value;
+		return static_cast<uint16_t>(~checksum_fold(sum));
+	}
+
+	// same for a field of any even size, e.g. an IPv6 address
+	inline uint16_t checksum_update(uint16_t checksum, const void* old_value, const void* new_value, size_t size) {
+		uint64_t sum = static_cast<uint16_t>(~checksum);
+		sum += static_cast<uint16_t>(~checksum_fold(checksum_add(old_value, size)));
+		sum = checksum_add(new_value, size, sum);
+		return static_cast<uint16_t>(~checksum_fold(sum));
+	}
+} // namespace cpp_socket::linklayer
+
+#endif // CHECKSUM_H
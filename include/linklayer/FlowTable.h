@@ -0,0 +1,449 @@
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <base/LockFreeQueue.h>
+#include <linklayer/PacketView.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+using cpp_socket::base::round_up_power_of_two;
+
+namespace cpp_socket::linklayer {
+	/*
+	5-tuple of a packet, addresses in network byte order, IPv4 addresses in the first
+	4 bytes. Padding is zeroed so keys compare and hash as plain bytes.
+	*/
+	struct FlowKey {
+		unsigned char source[16] = {};
+		unsigned char destination[16] = {};
+		uint16_t source_port = 0;
+		uint16_t destination_port = 0;
+		uint8_t protocol = 0;
+		// AF_INET or AF_INET6
+		uint8_t family = 0;
+		uint8_t padding[2] = {};
+
+		bool operator==(const FlowKey& other) const {
+			return memcmp(this, &other, sizeof(FlowKey)) == 0;
+		}
+
+		/*
+		Reads the 5-tuple of an IP packet, ports are 0 for protocols without them and
+		for fragments past the first.
+		- bidirectional: both directions of a connection give the same key, the lower
+		  address/port pair becomes the source.
+		- reversed: optional, set if the endpoints were swapped.
+		- Returns false if the frame is not IP.
+		*/
+		static bool from_packet(PacketView& packet, FlowKey& key, bool bidirectional = true, bool* reversed = nullptr) {
+			key = FlowKey{};
+			if (packet.ipv4().valid()) {
+				key.family = AF_INET;
+				store32(key.source, packet.ipv4().source());
+				store32(key.destination, packet.ipv4().destination());
+				key.protocol = packet.ipv4().protocol();
+			}
+			else if (packet.ipv6().valid()) {
+				key.family = AF_INET6;
+				memcpy(key.source, packet.ipv6().source(), 16);
+				memcpy(key.destination, packet.ipv6().destination(), 16);
+				key.protocol = packet.ipv6().protocol();
+			}
+			else {
+				return false;
+			}
+			if (packet.tcp().valid()) {
+				key.source_port = packet.tcp().source_port();
+				key.destination_port = packet.tcp().destination_port();
+			}
+			else if (packet.udp().valid()) {
+				key.source_port = packet.udp().source_port();
+				key.destination_port = packet.udp().destination_port();
+			}
+			bool swap = false;
+			if (bidirectional) {
+				int order = memcmp(key.source, key.destination, 16);
+				swap = order > 0 || (order == 0 && key.source_port > key.destination_port);
+				if (swap) {
+					std::swap(key.source, key.destination);
+					std::swap(key.source_port, key.destination_port);
+				}
+			}
+			if (reversed != nullptr) {
+				*reversed = swap;
+			}
+			return true;
+		}
+
+		/*
+		Computed once per packet and passed to the table and the shard selection. The
+		kernel's FANOUT_HASH uses a random per-boot seed, so its value cannot be
+		reproduced, but a bidirectional key hashes the same for both directions just as
+		fanout does: flows stay on the thread fanout picked.
+		*/
+		uint64_t hash() const {
+			uint64_t words[sizeof(FlowKey) / 8];
+			memcpy(words, this, sizeof(words));
+			uint64_t h = 0x9e3779b97f4a7c15ull;
+			for (uint64_t word: words) {
+				h = (h ^ word) * 0xff51afd7ed558ccdull;
+				h ^= h >> 32;
+			}
+			// murmur3 finalizer
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ull;
+			h ^= h >> 33;
+			return h;
+		}
+	};
+
+	static_assert(sizeof(FlowKey) == 40, "FlowKey is hashed as five 64 bit words");
+
+	/*
+	Open addressing hash table of per flow state, laid out like a Swiss table: a control
+	byte per slot holds 7 bits of the hash, 16 of them (a group) are compared to the
+	looked up hash in one SSE2 instruction, so a lookup touches one cache line of
+	control bytes and usually a single slot. The capacity is fixed at construction,
+	slots are allocated up front and never reallocated, at most 7/8 of them are used.
+	An insert can move flows within the slots (see rehash), so a Value pointer is only
+	valid until the next insert.
+
+	Not thread safe: give each capture thread its own table (shard) and spread packets
+	with RawSocket::set_fanout or by shard_of, a flow then always meets the same table.
+	Idle flows are removed by expire, a bounded slice of the table per call.
+	- Value: per flow state, default constructible.
+	*/
+	template <typename Value>
+	class FlowTable {
+	public:
+		/*
+		- capacity: rounded up to a power of two, at least 16. Memory is capacity *
+		  (sizeof(FlowKey) + sizeof(Value) + 9) bytes.
+		- idle_timeout_ns: flows not seen for this long are removed by expire.
+		*/
+		FlowTable(size_t capacity, int64_t idle_timeout_ns)
+			:idle_timeout(idle_timeout_ns) {
+			size_t groups = round_up_power_of_two(std::max(capacity, GROUP_SIZE)) / GROUP_SIZE;
+			group_mask = groups - 1;
+			control.resize(groups);
+			slots.resize(groups * GROUP_SIZE);
+			max_size = slots.size() - slots.size() / 8;
+			clear();
+		}
+
+		FlowTable(const FlowTable&) = delete;
+		FlowTable& operator=(const FlowTable&) = delete;
+
+		Value* find(const FlowKey& key) {
+			return find(key, key.hash());
+		}
+
+		// hash: key.hash(), when the caller already computed it
+		Value* find(const FlowKey& key, uint64_t hash) {
+			size_t index = find_index(key, hash);
+			return index == NOT_FOUND ? nullptr : &slots[index].value;
+		}
+
+		Value* find_or_insert(const FlowKey& key, int64_t now_ns, bool* inserted = nullptr) {
+			return find_or_insert(key, key.hash(), now_ns, inserted);
+		}
+
+		/*
+		Looks the flow up and marks it seen at now_ns, inserting a default constructed
+		value if it is new.
+		- inserted: optional, set if the flow is new.
+		- Returns nullptr if the flow is new and the table is full, expire more often or
+		  size it larger.
+		*/
+		Value* find_or_insert(const FlowKey& key, uint64_t hash, int64_t now_ns, bool* inserted = nullptr) {
+			size_t index = find_index(key, hash);
+			if (inserted != nullptr) {
+				*inserted = index == NOT_FOUND;
+			}
+			if (index != NOT_FOUND) {
+				slots[index].last_seen = now_ns;
+				return &slots[index].value;
+			}
+			if (count == max_size) {
+				return nullptr;
+			}
+			index = find_free(hash);
+			if (control_byte(index) == EMPTY) {
+				if (growth_left == 0) {
+					// the free slots are all tombstones, rebuild to make lookups terminate early again
+					rehash();
+					index = find_free(hash);
+				}
+				growth_left--;
+			}
+			set_control(index, h2(hash));
+			slots[index].key = key;
+			slots[index].last_seen = now_ns;
+			slots[index].value = Value{};
+			count++;
+			return &slots[index].value;
+		}
+
+		/*
+		Starts loading the control bytes and first slot of a flow, call it for the next
+		packets of a received batch before looking up the current one.
+		*/
+		void prefetch(uint64_t hash) {
+			size_t group = h1(hash) & group_mask;
+			__builtin_prefetch(&control[group]);
+			__builtin_prefetch(&slots[group * GROUP_SIZE]);
+		}
+
+		bool erase(const FlowKey& key) {
+			size_t index = find_index(key, key.hash());
+			if (index == NOT_FOUND) {
+				return false;
+			}
+			erase_index(index);
+			return true;
+		}
+
+		/*
+		Removes flows idle for longer than the timeout, scanning at most budget slots
+		from where the last call stopped, so the cost per call is bounded.
+		- on_expire: called as on_expire(const FlowKey&, Value&) before a flow is removed.
+		- Returns the number of flows removed.
+		*/
+		template <typename F>
+		size_t expire(int64_t now_ns, size_t budget, F&& on_expire) {
+			size_t expired = 0;
+			budget = std::min(budget, slots.size());
+			for (size_t i = 0; i < budget; i++) {
+				size_t index = cursor;
+				cursor = (cursor + 1) & (slots.size() - 1);
+				if (is_full(control_byte(index)) && now_ns - slots[index].last_seen > idle_timeout) {
+					on_expire(slots[index].key, slots[index].value);
+					erase_index(index);
+					expired++;
+				}
+			}
+			return expired;
+		}
+
+		size_t expire(int64_t now_ns, size_t budget) {
+			return expire(now_ns, budget, [](const FlowKey&, Value&) {});
+		}
+
+		// calls f(const FlowKey&, Value&, int64_t last_seen) for every flow
+		template <typename F>
+		void for_each(F&& f) {
+			for (size_t i = 0; i < slots.size(); i++) {
+				if (is_full(control_byte(i))) {
+					f(slots[i].key, slots[i].value, slots[i].last_seen);
+				}
+			}
+		}
+
+		void clear() {
+			for (Group& group: control) {
+				memset(group.bytes, EMPTY, GROUP_SIZE);
+			}
+			count = 0;
+			growth_left = max_size;
+			cursor = 0;
+		}
+
+		size_t size() {
+			return count;
+		}
+
+		// slots, the table holds at most 7/8 of them
+		size_t capacity() {
+			return slots.size();
+		}
+
+		size_t memory_bytes() {
+			return slots.size() * sizeof(Slot) + control.size() * sizeof(Group);
+		}
+
+		// spreads flows over shards (e.g. threads) by the high bits of the hash, which the table does not use
+		static size_t shard_of(uint64_t hash, size_t shards) {
+			return static_cast<size_t>((static_cast<unsigned __int128>(hash) * shards) >> 64);
+		}
+	private:
+		static constexpr size_t GROUP_SIZE = 16;
+		static constexpr size_t NOT_FOUND = ~size_t(0);
+		// full slots hold 7 hash bits, the high bit marks the free states
+		static constexpr int8_t EMPTY = -128;
+		static constexpr int8_t DELETED = -2;
+
+		struct alignas(GROUP_SIZE) Group {
+			int8_t bytes[GROUP_SIZE];
+		};
+
+		struct Slot {
+			FlowKey key;
+			int64_t last_seen = 0;
+			Value value{};
+		};
+
+		static int8_t h2(uint64_t hash) {
+			return static_cast<int8_t>(hash & 0x7f);
+		}
+
+		static size_t h1(uint64_t hash) {
+			return static_cast<size_t>(hash >> 7);
+		}
+
+		static bool is_full(int8_t byte) {
+			return byte >= 0;
+		}
+
+		int8_t control_byte(size_t index) {
+			return control[index / GROUP_SIZE].bytes[index % GROUP_SIZE];
+		}
+
+		void set_control(size_t index, int8_t byte) {
+			control[index / GROUP_SIZE].bytes[index % GROUP_SIZE] = byte;
+		}
+
+		// bit i set where byte i of the group equals value
+		static uint32_t match(const Group& group, int8_t value) {
+			#if defined(__SSE2__)
+			__m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(group.bytes));
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value))));
+			#else
+			uint32_t mask = 0;
+			for (size_t i = 0; i < GROUP_SIZE; i++) {
+				mask |= static_cast<uint32_t>(group.bytes[i] == value) << i;
+			}
+			return mask;
+			#endif
+		}
+
+		// bit i set where slot i of the group is empty or deleted
+		static uint32_t match_free(const Group& group) {
+			#if defined(__SSE2__)
+			__m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(group.bytes));
+			return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+			#else
+			uint32_t mask = 0;
+			for (size_t i = 0; i < GROUP_SIZE; i++) {
+				mask |= static_cast<uint32_t>(group.bytes[i] < 0) << i;
+			}
+			return mask;
+			#endif
+		}
+
+		/*
+		Groups are probed in triangular steps from h1, which visits every group once
+		since their count is a power of two. A group with an empty slot ends the probe:
+		an insert would have used it.
+		*/
+		size_t find_index(const FlowKey& key, uint64_t hash) {
+			size_t group = h1(hash) & group_mask;
+			int8_t tag = h2(hash);
+			for (size_t step = 1; step <= group_mask + 1; step++) {
+				const Group& g = control[group];
+				for (uint32_t mask = match(g, tag); mask != 0; mask &= mask - 1) {
+					size_t index = group * GROUP_SIZE + __builtin_ctz(mask);
+					if (slots[index].key == key) {
+						return index;
+					}
+				}
+				if (match(g, EMPTY) != 0) {
+					return NOT_FOUND;
+				}
+				group = (group + step) & group_mask;
+			}
+			return NOT_FOUND;
+		}
+
+		// first empty or deleted slot on the probe sequence, the table is never full
+		size_t find_free(uint64_t hash) {
+			size_t group = h1(hash) & group_mask;
+			for (size_t step = 1;; step++) {
+				uint32_t mask = match_free(control[group]);
+				if (mask != 0) {
+					return group * GROUP_SIZE + __builtin_ctz(mask);
+				}
+				group = (group + step) & group_mask;
+			}
+		}
+
+		/*
+		A probe only moves past a group without empty slots, so a slot in a group that
+		still has one can become empty again, otherwise it is left as a tombstone.
+		*/
+		void erase_index(size_t index) {
+			slots[index].value = Value{};
+			if (match(control[index / GROUP_SIZE], EMPTY) != 0) {
+				set_control(index, EMPTY);
+				growth_left++;
+			}
+			else {
+				set_control(index, DELETED);
+			}
+			count--;
+		}
+
+		/*
+		Reinserts every flow at the same capacity, dropping the tombstones, in place like
+		Swiss tables do: full slots are marked DELETED and tombstones EMPTY, then every
+		marked flow is moved to the first free slot of its probe sequence, swapping with
+		a marked flow that is still to be placed. It allocates nothing and runs once the
+		inserts since the last rebuild used up the free slots, so its O(capacity) pass is
+		amortized over them. The insert that triggers it still stalls for the pass, about
+		100 ms at 4M slots; expiring flows keeps tombstones rare, erase_index only leaves
+		them in groups without an empty slot.
+		*/
+		void rehash() {
+			for (Group& group: control) {
+				for (size_t i = 0; i < GROUP_SIZE; i++) {
+					group.bytes[i] = is_full(group.bytes[i]) ? DELETED : EMPTY;
+				}
+			}
+			for (size_t i = 0; i < slots.size(); i++) {
+				if (control_byte(i) != DELETED) {
+					continue;
+				}
+				uint64_t hash = slots[i].key.hash();
+				size_t index = find_free(hash);
+				if (index / GROUP_SIZE == i / GROUP_SIZE) {
+					// the probe reaches this group first anyway, no need to move
+					set_control(i, h2(hash));
+				}
+				else if (control_byte(index) == EMPTY) {
+					set_control(index, h2(hash));
+					slots[index] = std::move(slots[i]);
+					slots[i].value = Value{};
+					set_control(i, EMPTY);
+				}
+				else {
+					// another flow still to be placed, take its slot and place it next
+					set_control(index, h2(hash));
+					std::swap(slots[index], slots[i]);
+					i--;
+				}
+			}
+			growth_left = max_size - count;
+		}
+
+		std::vector<Group> control;
+		std::vector<Slot> slots;
+		size_t group_mask;
+		size_t max_size;
+		size_t count = 0;
+		// inserts left before only tombstones remain free
+		size_t growth_left = 0;
+		size_t cursor = 0;
+		int64_t idle_timeout;
+	};
+} // namespace cpp_socket::linklayer
+
+#endif // FLOW_TABLE_H
@@ -0,0 +1,768 @@
+#ifndef PACKET_VIEW_H
+#define PACKET_VIEW_H
+
+#include <linklayer/Checksum.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace cpp_socket::linklayer {
+	/*
+	Zero-copy views over the headers of a frame, e.g. a buffer filled by
+	RawSocket::receive_wrapper. A view is a pointer and a size into the caller's
+	buffer, checks its bounds once when constructed and is invalid (valid() is false)
+	if the header does not fit or is malformed. Getters return host byte order,
+	setters write network byte order and keep the checksum of the header they change
+	up to date incrementally. Views must not outlive the buffer.
+	*/
+	inline uint16_t load16(const unsigned char* p) {
+		uint16_t v;
+		memcpy(&v, p, 2);
+		return ntohs(v);
+	}
+
+	inline uint32_t load32(const unsigned char* p) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		return ntohl(v);
+	}
+
+	inline void store16(unsigned char* p, uint16_t value) {
+		value = htons(value);
+		memcpy(p, &value, 2);
+	}
+
+	inline void store32(unsigned char* p, uint32_t value) {
+		value = htonl(value);
+		memcpy(p, &value, 4);
+	}
+
+	// a 16 bit field in memory order, the form checksum functions take
+	inline uint16_t raw16(const unsigned char* p) {
+		uint16_t v;
+		memcpy(&v, p, 2);
+		return v;
+	}
+
+	inline uint32_t raw32(const unsigned char* p) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+
+	enum ether_type_t: uint16_t {
+		ETHER_TYPE_IPV4 = 0x0800,
+		ETHER_TYPE_ARP = 0x0806,
+		ETHER_TYPE_VLAN = 0x8100,
+		ETHER_TYPE_QINQ = 0x88a8,
+		ETHER_TYPE_IPV6 = 0x86dd
+	};
+
+	/*
+	Ethernet II header with up to MAX_VLAN_TAGS stacked 802.1Q / 802.1ad tags.
+	*/
+	class EthernetView {
+	public:
+		static constexpr size_t HEADER_SIZE = 14;
+		static constexpr size_t VLAN_TAG_SIZE = 4;
+		static constexpr int MAX_VLAN_TAGS = 2;
+
+		EthernetView() = default;
+
+		EthernetView(unsigned char* data, size_t size)
+			:data(data), size(size) {
+			if (size < HEADER_SIZE) {
+				this->data = nullptr;
+				return;
+			}
+			header_size = HEADER_SIZE;
+			uint16_t type = load16(data + 12);
+			while (type == ETHER_TYPE_VLAN || type == ETHER_TYPE_QINQ) {
+				if (vlan_tags == MAX_VLAN_TAGS || header_size + VLAN_TAG_SIZE > size) {
+					this->data = nullptr;
+					return;
+				}
+				vlan_tags++;
+				header_size += VLAN_TAG_SIZE;
+				type = load16(data + header_size - 2);
+			}
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		unsigned char* destination() {
+			return data;
+		}
+
+		unsigned char* source() {
+			return data + 6;
+		}
+
+		// the type of the payload, after the VLAN tags
+		uint16_t ether_type() const {
+			return load16(data + header_size - 2);
+		}
+
+		int vlan_count() const {
+			return vlan_tags;
+		}
+
+		// 12 bit VLAN id of the tag, 0 is the outermost
+		uint16_t vlan_id(int tag) const {
+			return load16(data + HEADER_SIZE + tag * VLAN_TAG_SIZE) & 0x0fff;
+		}
+
+		uint8_t vlan_priority(int tag) const {
+			return data[HEADER_SIZE + tag * VLAN_TAG_SIZE] >> 5;
+		}
+
+		size_t header_length() const {
+			return header_size;
+		}
+
+		unsigned char* payload() {
+			return data + header_size;
+		}
+
+		size_t payload_size() const {
+			return size - header_size;
+		}
+	private:
+		unsigned char* data = nullptr;
+		size_t size = 0;
+		size_t header_size = 0;
+		int vlan_tags = 0;
+	};
+
+	/*
+	IPv4 header including options. The payload ends at total length, Ethernet padding
+	is cut off, a total length beyond the buffer makes the view invalid.
+	*/
+	class Ipv4View {
+	public:
+		static constexpr size_t MIN_HEADER_SIZE = 20;
+
+		Ipv4View() = default;
+
+		Ipv4View(unsigned char* data, size_t size)
+			:data(data) {
+			if (size < MIN_HEADER_SIZE || (data[0] >> 4) != 4) {
+				this->data = nullptr;
+				return;
+			}
+			header_size = (data[0] & 0x0f) * 4;
+			packet_size = load16(data + 2);
+			if (header_size < MIN_HEADER_SIZE || packet_size < header_size || packet_size > size) {
+				this->data = nullptr;
+			}
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		size_t header_length() const {
+			return header_size;
+		}
+
+		uint16_t total_length() const {
+			return packet_size;
+		}
+
+		uint8_t dscp() const {
+			return data[1] >> 2;
+		}
+
+		uint16_t identification() const {
+			return load16(data + 4);
+		}
+
+		bool dont_fragment() const {
+			return data[6] & 0x40;
+		}
+
+		// a fragment other than a whole packet, only the first one carries the transport header
+		bool is_fragment() const {
+			return (load16(data + 6) & 0x3fff) != 0;
+		}
+
+		uint16_t fragment_offset() const {
+			return (load16(data + 6) & 0x1fff) * 8;
+		}
+
+		uint8_t ttl() const {
+			return data[8];
+		}
+
+		uint8_t protocol() const {
+			return data[9];
+		}
+
+		uint32_t source() const {
+			return load32(data + 12);
+		}
+
+		uint32_t destination() const {
+			return load32(data + 16);
+		}
+
+		bool verify_checksum() const {
+			return checksum_verify(data, header_size);
+		}
+
+		void update_checksum() {
+			memset(data + 10, 0, 2);
+			uint16_t checksum = checksum_compute(data, header_size);
+			memcpy(data + 10, &checksum, 2);
+		}
+
+		void set_ttl(uint8_t ttl) {
+			// ttl and protocol share a 16 bit word
+			uint16_t before = raw16(data + 8);
+			data[8] = ttl;
+			patch_checksum(before, raw16(data + 8));
+		}
+
+		void set_source(uint32_t address) {
+			set_address(12, address);
+		}
+
+		void set_destination(uint32_t address) {
+			set_address(16, address);
+		}
+
+		/*
+		Sum of the pseudo header for the TCP/UDP checksum, pass it to their
+		verify_checksum and update_checksum.
+		*/
+		uint64_t pseudo_header_sum() const {
+			uint64_t sum = checksum_add(data + 12, 8);
+			unsigned char rest[4] = {0, protocol()};
+			store16(rest + 2, payload_size());
+			return checksum_add(rest, 4, sum);
+		}
+
+		unsigned char* payload() {
+			return data + header_size;
+		}
+
+		size_t payload_size() const {
+			return packet_size - header_size;
+		}
+	private:
+		void set_address(size_t offset, uint32_t address) {
+			uint32_t before = raw32(data + offset);
+			store32(data + offset, address);
+			uint16_t checksum = checksum_update32(raw16(data + 10), before, raw32(data + offset));
+			memcpy(data + 10, &checksum, 2);
+		}
+
+		void patch_checksum(uint16_t before, uint16_t after) {
+			uint16_t checksum = checksum_update16(raw16(data + 10), before, after);
+			memcpy(data + 10, &checksum, 2);
+		}
+
+		unsigned char* data = nullptr;
+		size_t header_size = 0;
+		size_t packet_size = 0;
+	};
+
+	/*
+	IPv6 header followed by its extension headers, protocol() and payload() refer to
+	the first header that is not an extension (TCP, UDP, ICMPv6, ...).
+	*/
+	class Ipv6View {
+	public:
+		static constexpr size_t HEADER_SIZE = 40;
+		static constexpr uint8_t HOP_BY_HOP = 0;
+		static constexpr uint8_t ROUTING = 43;
+		static constexpr uint8_t FRAGMENT = 44;
+		static constexpr uint8_t AUTHENTICATION = 51;
+		static constexpr uint8_t DESTINATION_OPTIONS = 60;
+		// a header chain longer than this is treated as malformed
+		static constexpr int MAX_EXTENSION_HEADERS = 8;
+
+		Ipv6View() = default;
+
+		Ipv6View(unsigned char* data, size_t size)
+			:data(data) {
+			if (size < HEADER_SIZE || (data[0] >> 4) != 6) {
+				this->data = nullptr;
+				return;
+			}
+			packet_size = HEADER_SIZE + load16(data + 4);
+			if (packet_size > size) {
+				this->data = nullptr;
+				return;
+			}
+			header_size = HEADER_SIZE;
+			next = data[6];
+			for (int i = 0; is_extension(next); i++) {
+				if (i == MAX_EXTENSION_HEADERS || header_size + 8 > packet_size) {
+					this->data = nullptr;
+					return;
+				}
+				const unsigned char* extension = data + header_size;
+				size_t length;
+				if (next == FRAGMENT) {
+					length = 8;
+					fragment = (load16(extension + 2) & 0xfff9) != 0;
+					offset = load16(extension + 2) & 0xfff8;
+				}
+				else if (next == AUTHENTICATION) {
+					length = (extension[1] + 2) * 4;
+				}
+				else {
+					length = (extension[1] + 1) * 8;
+				}
+				if (header_size + length > packet_size) {
+					this->data = nullptr;
+					return;
+				}
+				next = extension[0];
+				header_size += length;
+				if (offset != 0) {
+					// the rest of a non-first fragment is payload, not a header chain
+					break;
+				}
+			}
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		// fixed header and extension headers
+		size_t header_length() const {
+			return header_size;
+		}
+
+		uint8_t traffic_class() const {
+			return static_cast<uint8_t>(load16(data) >> 4);
+		}
+
+		uint32_t flow_label() const {
+			return load32(data) & 0xfffff;
+		}
+
+		uint8_t hop_limit() const {
+			return data[7];
+		}
+
+		// the upper layer protocol after the extension headers
+		uint8_t protocol() const {
+			return next;
+		}
+
+		bool is_fragment() const {
+			return fragment;
+		}
+
+		uint16_t fragment_offset() const {
+			return offset;
+		}
+
+		unsigned char* source() {
+			return data + 8;
+		}
+
+		unsigned char* destination() {
+			return data + 24;
+		}
+
+		// no checksum in the IPv6 header
+		void set_hop_limit(uint8_t hop_limit) {
+			data[7] = hop_limit;
+		}
+
+		uint64_t pseudo_header_sum() const {
+			uint64_t sum = checksum_add(data + 8, 32);
+			unsigned char rest[8] = {};
+			store32(rest, payload_size());
+			rest[7] = next;
+			return checksum_add(rest, 8, sum);
+		}
+
+		unsigned char* payload() {
+			return data + header_size;
+		}
+
+		size_t payload_size() const {
+			return packet_size - header_size;
+		}
+	private:
+		static bool is_extension(uint8_t protocol) {
+			return protocol == HOP_BY_HOP || protocol == ROUTING || protocol == FRAGMENT
+				|| protocol == AUTHENTICATION || protocol == DESTINATION_OPTIONS;
+		}
+
+		unsigned char* data = nullptr;
+		size_t header_size = 0;
+		size_t packet_size = 0;
+		uint8_t next = 0;
+		bool fragment = false;
+		uint16_t offset = 0;
+	};
+
+	/*
+	TCP header including options, the size is the L3 payload size.
+	*/
+	class TcpView {
+	public:
+		static constexpr size_t MIN_HEADER_SIZE = 20;
+		static constexpr uint8_t FIN = 0x01;
+		static constexpr uint8_t SYN = 0x02;
+		static constexpr uint8_t RST = 0x04;
+		static constexpr uint8_t PSH = 0x08;
+		static constexpr uint8_t ACK = 0x10;
+		static constexpr uint8_t URG = 0x20;
+
+		TcpView() = default;
+
+		TcpView(unsigned char* data, size_t size)
+			:data(data), size(size) {
+			if (size < MIN_HEADER_SIZE) {
+				this->data = nullptr;
+				return;
+			}
+			header_size = (data[12] >> 4) * 4;
+			if (header_size < MIN_HEADER_SIZE || header_size > size) {
+				this->data = nullptr;
+			}
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		size_t header_length() const {
+			return header_size;
+		}
+
+		uint16_t source_port() const {
+			return load16(data);
+		}
+
+		uint16_t destination_port() const {
+			return load16(data + 2);
+		}
+
+		uint32_t sequence() const {
+			return load32(data + 4);
+		}
+
+		uint32_t acknowledgment() const {
+			return load32(data + 8);
+		}
+
+		uint8_t flags() const {
+			return data[13];
+		}
+
+		uint16_t window() const {
+			return load16(data + 14);
+		}
+
+		unsigned char* options() {
+			return data + MIN_HEADER_SIZE;
+		}
+
+		size_t options_size() const {
+			return header_size - MIN_HEADER_SIZE;
+		}
+
+		void set_source_port(uint16_t port) {
+			set16(0, port);
+		}
+
+		void set_destination_port(uint16_t port) {
+			set16(2, port);
+		}
+
+		// pseudo: Ipv4View/Ipv6View::pseudo_header_sum()
+		bool verify_checksum(uint64_t pseudo) const {
+			return checksum_verify(data, size, pseudo);
+		}
+
+		void update_checksum(uint64_t pseudo) {
+			memset(data + 16, 0, 2);
+			uint16_t checksum = checksum_compute(data, size, pseudo);
+			memcpy(data + 16, &checksum, 2);
+		}
+
+		/*
+		Keeps the checksum right after the pseudo header changed, e.g. after NAT rewrote an
+		IPv4 address: pass the old and new address in memory order (raw32).
+		*/
+		void patch_checksum(uint32_t old_value, uint32_t new_value) {
+			uint16_t checksum = checksum_update32(raw16(data + 16), old_value, new_value);
+			memcpy(data + 16, &checksum, 2);
+		}
+
+		unsigned char* payload() {
+			return data + header_size;
+		}
+
+		size_t payload_size() const {
+			return size - header_size;
+		}
+	private:
+		void set16(size_t offset, uint16_t value) {
+			uint16_t before = raw16(data + offset);
+			store16(data + offset, value);
+			uint16_t checksum = checksum_update16(raw16(data + 16), before, raw16(data + offset));
+			memcpy(data + 16, &checksum, 2);
+		}
+
+		unsigned char* data = nullptr;
+		size_t size = 0;
+		size_t header_size = 0;
+	};
+
+	/*
+	UDP header, the datagram ends at the UDP length. A checksum of 0 means none was
+	sent (IPv4 only), verify_checksum accepts it.
+	*/
+	class UdpView {
+	public:
+		static constexpr size_t HEADER_SIZE = 8;
+
+		UdpView() = default;
+
+		UdpView(unsigned char* data, size_t size)
+			:data(data) {
+			if (size < HEADER_SIZE) {
+				this->data = nullptr;
+				return;
+			}
+			datagram_size = load16(data + 4);
+			if (datagram_size < HEADER_SIZE || datagram_size > size) {
+				this->data = nullptr;
+			}
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		uint16_t source_port() const {
+			return load16(data);
+		}
+
+		uint16_t destination_port() const {
+			return load16(data + 2);
+		}
+
+		uint16_t length() const {
+			return datagram_size;
+		}
+
+		bool has_checksum() const {
+			return raw16(data + 6) != 0;
+		}
+
+		void set_source_port(uint16_t port) {
+			set16(0, port);
+		}
+
+		void set_destination_port(uint16_t port) {
+			set16(2, port);
+		}
+
+		bool verify_checksum(uint64_t pseudo) const {
+			return !has_checksum() || checksum_verify(data, datagram_size, pseudo);
+		}
+
+		void update_checksum(uint64_t pseudo) {
+			memset(data + 6, 0, 2);
+			store_checksum(checksum_compute(data, datagram_size, pseudo));
+		}
+
+		void patch_checksum(uint32_t old_value, uint32_t new_value) {
+			if (has_checksum()) {
+				store_checksum(checksum_update32(raw16(data + 6), old_value, new_value));
+			}
+		}
+
+		unsigned char* payload() {
+			return data + HEADER_SIZE;
+		}
+
+		size_t payload_size() const {
+			return datagram_size - HEADER_SIZE;
+		}
+	private:
+		void set16(size_t offset, uint16_t value) {
+			uint16_t before = raw16(data + offset);
+			store16(data + offset, value);
+			if (has_checksum()) {
+				store_checksum(checksum_update16(raw16(data + 6), before, raw16(data + offset)));
+			}
+		}
+
+		// 0 is reserved for no checksum, an update can produce it as well as a full computation
+		void store_checksum(uint16_t checksum) {
+			if (checksum == 0) {
+				checksum = 0xffff;
+			}
+			memcpy(data + 6, &checksum, 2);
+		}
+
+		unsigned char* data = nullptr;
+		size_t datagram_size = 0;
+	};
+
+	/*
+	ICMP and ICMPv6 header. ICMP checksums cover the message only, ICMPv6 also the
+	IPv6 pseudo header.
+	*/
+	class IcmpView {
+	public:
+		static constexpr size_t HEADER_SIZE = 8;
+
+		IcmpView() = default;
+
+		IcmpView(unsigned char* data, size_t size)
+			:data(data), size(size) {
+			if (size < HEADER_SIZE) {
+				this->data = nullptr;
+			}
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		uint8_t type() const {
+			return data[0];
+		}
+
+		uint8_t code() const {
+			return data[1];
+		}
+
+		// identifier and sequence of echo messages, type specific otherwise
+		uint32_t rest_of_header() const {
+			return load32(data + 4);
+		}
+
+		// pseudo: 0 for ICMP, Ipv6View::pseudo_header_sum() for ICMPv6
+		bool verify_checksum(uint64_t pseudo = 0) const {
+			return checksum_verify(data, size, pseudo);
+		}
+
+		void update_checksum(uint64_t pseudo = 0) {
+			memset(data + 2, 0, 2);
+			uint16_t checksum = checksum_compute(data, size, pseudo);
+			memcpy(data + 2, &checksum, 2);
+		}
+
+		unsigned char* payload() {
+			return data + HEADER_SIZE;
+		}
+
+		size_t payload_size() const {
+			return size - HEADER_SIZE;
+		}
+	private:
+		unsigned char* data = nullptr;
+		size_t size = 0;
+	};
+
+	/*
+	Parses a whole Ethernet frame down to the transport header in one pass. The
+	views of layers that are not present (or are fragments past the first) are invalid.
+	*/
+	class PacketView {
+	public:
+		PacketView(unsigned char* frame, size_t size)
+			:eth(frame, size) {
+			if (!eth.valid()) {
+				return;
+			}
+			uint8_t protocol;
+			unsigned char* l4;
+			size_t l4_size;
+			if (eth.ether_type() == ETHER_TYPE_IPV4) {
+				ip4 = Ipv4View(eth.payload(), eth.payload_size());
+				if (!ip4.valid() || ip4.fragment_offset() != 0) {
+					return;
+				}
+				protocol = ip4.protocol();
+				l4 = ip4.payload();
+				l4_size = ip4.payload_size();
+			}
+			else if (eth.ether_type() == ETHER_TYPE_IPV6) {
+				ip6 = Ipv6View(eth.payload(), eth.payload_size());
+				if (!ip6.valid() || ip6.fragment_offset() != 0) {
+					return;
+				}
+				protocol = ip6.protocol();
+				l4 = ip6.payload();
+				l4_size = ip6.payload_size();
+			}
+			else {
+				return;
+			}
+
+			transport_protocol = protocol;
+			if (protocol == IPPROTO_TCP) {
+				tcp_view = TcpView(l4, l4_size);
+			}
+			else if (protocol == IPPROTO_UDP) {
+				udp_view = UdpView(l4, l4_size);
+			}
+			else if (protocol == IPPROTO_ICMP || protocol == IPPROTO_ICMPV6) {
+				icmp_view = IcmpView(l4, l4_size);
+			}
+		}
+
+		EthernetView& ethernet() {
+			return eth;
+		}
+
+		Ipv4View& ipv4() {
+			return ip4;
+		}
+
+		Ipv6View& ipv6() {
+			return ip6;
+		}
+
+		// IPPROTO_* of the transport header, 0 without IP
+		uint8_t protocol() const {
+			return transport_protocol;
+		}
+
+		TcpView& tcp() {
+			return tcp_view;
+		}
+
+		UdpView& udp() {
+			return udp_view;
+		}
+
+		IcmpView& icmp() {
+			return icmp_view;
+		}
+
+		// pseudo header sum of the IP layer, for the transport checksum
+		uint64_t pseudo_header_sum() const {
+			return ip4.valid() ? ip4.pseudo_header_sum() : ip6.valid() ? ip6.pseudo_header_sum() : 0;
+		}
+	private:
+		EthernetView eth;
+		Ipv4View ip4;
+		Ipv6View ip6;
+		TcpView tcp_view;
+		UdpView udp_view;
+		IcmpView icmp_view;
+		uint8_t transport_protocol = 0;
+	};
+} // namespace cpp_socket::linklayer
+
+#endif // PACKET_VIEW_H
@@ -0,0 +1,297 @@
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <linklayer/PcapWriter.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::linklayer {
+	// a frame inside the mapped file, valid as long as the reader
+	struct CapturedFrame {
+		const unsigned char* data;
+		uint32_t size;
+		// size on the wire, bigger than size if the capture was cut to a snaplen
+		uint32_t original_size;
+		// nanoseconds since the epoch
+		int64_t timestamp_ns;
+		uint16_t link_type;
+	};
+
+	/*
+	Reads pcap (micro- and nanosecond, either byte order) and pcapng files through a
+	read-only mapping, frames are handed out in place without copying. pcapng sections
+	and interfaces with any if_tsresol/if_tsoffset are supported, blocks other than
+	packets are skipped.
+	*/
+	class PcapReader {
+	public:
+		// throws if the file cannot be mapped or is neither pcap nor pcapng
+		explicit PcapReader(const std::string& path) {
+			int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd == -1) {
+				throw std::runtime_error("Failed to open capture file.");
+			}
+			struct stat st;
+			if (fstat(fd, &st) == -1 || st.st_size < 4) {
+				close(fd);
+				throw std::runtime_error("Capture file is empty.");
+			}
+			size = st.st_size;
+			// prefaulted, so reading frames never stalls on the disk
+			void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+			close(fd);
+			if (mapping == MAP_FAILED) {
+				throw std::runtime_error("Failed to map capture file.");
+			}
+			data = static_cast<const unsigned char*>(mapping);
+			madvise(mapping, size, MADV_SEQUENTIAL);
+
+			uint32_t magic;
+			memcpy(&magic, data, sizeof(magic));
+			if (magic == PCAPNG_SECTION_HEADER) {
+				file_format = PCAPNG;
+			}
+			else if (magic == PCAP_MAGIC_MICROSECONDS || magic == __builtin_bswap32(PCAP_MAGIC_MICROSECONDS)
+				|| magic == PCAP_MAGIC_NANOSECONDS || magic == __builtin_bswap32(PCAP_MAGIC_NANOSECONDS)) {
+				file_format = PCAP;
+			}
+			else {
+				munmap(mapping, size);
+				throw std::runtime_error("Not a pcap or pcapng file.");
+			}
+			rewind();
+		}
+
+		PcapReader(const PcapReader&) = delete;
+		PcapReader& operator=(const PcapReader&) = delete;
+
+		~PcapReader() {
+			munmap(const_cast<unsigned char*>(data), size);
+		}
+
+		/*
+		- Returns false at the end of the file, or where a block is cut off or malformed
+		  (see is_truncated), e.g. a capture still being written.
+		*/
+		bool next(CapturedFrame& frame) {
+			return file_format == PCAP ? next_pcap(frame) : next_pcapng(frame);
+		}
+
+		// starts over at the first frame
+		void rewind() {
+			truncated = false;
+			swapped = false;
+			interfaces.clear();
+			if (file_format == PCAP) {
+				uint32_t magic;
+				memcpy(&magic, data, sizeof(magic));
+				swapped = magic != PCAP_MAGIC_MICROSECONDS && magic != PCAP_MAGIC_NANOSECONDS;
+				magic = read32(data);
+				nanoseconds = magic == PCAP_MAGIC_NANOSECONDS;
+				if (size < PCAP_FILE_HEADER_SIZE) {
+					truncated = true;
+					offset = size;
+					return;
+				}
+				pcap_link_type = static_cast<uint16_t>(read32(data + 20));
+				offset = PCAP_FILE_HEADER_SIZE;
+			}
+			else {
+				offset = 0;
+			}
+		}
+
+		capture_format_t format() {
+			return file_format;
+		}
+
+		// the last next() stopped before the end of the file
+		bool is_truncated() {
+			return truncated;
+		}
+
+		size_t file_size() {
+			return size;
+		}
+	private:
+		static constexpr uint32_t PCAPNG_PACKET = 2;
+		static constexpr uint32_t PCAPNG_SIMPLE_PACKET = 3;
+		static constexpr uint16_t OPTION_TSRESOL = 9;
+		static constexpr uint16_t OPTION_TSOFFSET = 14;
+
+		struct Interface {
+			uint16_t link_type;
+			uint32_t snaplen;
+			// timestamp units per second, a power of 10 or 2
+			uint64_t units_per_second = 1000000;
+			int64_t offset_seconds = 0;
+		};
+
+		uint16_t read16(const unsigned char* p) {
+			uint16_t value;
+			memcpy(&value, p, sizeof(value));
+			return swapped ? __builtin_bswap16(value) : value;
+		}
+
+		uint32_t read32(const unsigned char* p) {
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return swapped ? __builtin_bswap32(value) : value;
+		}
+
+		bool next_pcap(CapturedFrame& frame) {
+			if (offset == size) {
+				return false;
+			}
+			if (size - offset < PCAP_RECORD_HEADER_SIZE) {
+				truncated = true;
+				return false;
+			}
+			const unsigned char* p = data + offset;
+			uint32_t captured = read32(p + 8);
+			if (size - offset - PCAP_RECORD_HEADER_SIZE < captured) {
+				truncated = true;
+				return false;
+			}
+			int64_t fraction = read32(p + 4);
+			frame.data = p + PCAP_RECORD_HEADER_SIZE;
+			frame.size = captured;
+			frame.original_size = read32(p + 12);
+			frame.timestamp_ns = static_cast<int64_t>(read32(p)) * 1000000000 + (nanoseconds ? fraction : fraction * 1000);
+			frame.link_type = pcap_link_type;
+			offset += PCAP_RECORD_HEADER_SIZE + captured;
+			return true;
+		}
+
+		bool next_pcapng(CapturedFrame& frame) {
+			while (offset < size) {
+				if (size - offset < 12) {
+					truncated = true;
+					return false;
+				}
+				const unsigned char* p = data + offset;
+				uint32_t type;
+				memcpy(&type, p, sizeof(type));
+				if (type == PCAPNG_SECTION_HEADER) {
+					// a new section may switch the byte order and starts without interfaces
+					uint32_t magic;
+					memcpy(&magic, p + 8, sizeof(magic));
+					swapped = magic != PCAPNG_BYTE_ORDER_MAGIC;
+					interfaces.clear();
+				}
+				type = read32(p);
+				uint32_t length = read32(p + 4);
+				if (length < 12 || length % 4 != 0 || length > size - offset) {
+					truncated = true;
+					return false;
+				}
+				offset += length;
+				const unsigned char* body = p + 8;
+				size_t body_size = length - 12;
+
+				if (type == PCAPNG_INTERFACE_DESCRIPTION && body_size >= 8) {
+					Interface interface{read16(body), read32(body + 4)};
+					parse_options(interface, body + 8, body_size - 8);
+					interfaces.push_back(interface);
+				}
+				else if (type == PCAPNG_ENHANCED_PACKET && body_size >= 20) {
+					uint32_t id = read32(body);
+					uint64_t units = static_cast<uint64_t>(read32(body + 4)) << 32 | read32(body + 8);
+					if (fill_frame(frame, id, units, read32(body + 12), read32(body + 16), body + 20, body_size - 20)) {
+						return true;
+					}
+				}
+				else if (type == PCAPNG_PACKET && body_size >= 20) {
+					// obsolete packet block: 16 bit interface id and drop count
+					uint64_t units = static_cast<uint64_t>(read32(body + 4)) << 32 | read32(body + 8);
+					if (fill_frame(frame, read16(body), units, read32(body + 12), read32(body + 16), body + 20, body_size - 20)) {
+						return true;
+					}
+				}
+				else if (type == PCAPNG_SIMPLE_PACKET && body_size >= 4 && !interfaces.empty()) {
+					// no timestamp, captured size implied by the snaplen
+					uint32_t original = read32(body);
+					uint32_t captured = std::min<uint32_t>(original, static_cast<uint32_t>(body_size - 4));
+					if (interfaces[0].snaplen > 0) {
+						captured = std::min(captured, interfaces[0].snaplen);
+					}
+					frame = {body + 4, captured, original, last_timestamp, interfaces[0].link_type};
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool fill_frame(CapturedFrame& frame, uint32_t id, uint64_t units, uint32_t captured, uint32_t original,
+			const unsigned char* packet, size_t available) {
+			if (id >= interfaces.size() || captured > available) {
+				return false;
+			}
+			const Interface& interface = interfaces[id];
+			uint64_t seconds = units / interface.units_per_second;
+			uint64_t remainder = units % interface.units_per_second;
+			last_timestamp = static_cast<int64_t>(seconds + interface.offset_seconds) * 1000000000
+				+ static_cast<int64_t>(static_cast<unsigned __int128>(remainder) * 1000000000 / interface.units_per_second);
+			frame = {packet, captured, original, last_timestamp, interface.link_type};
+			return true;
+		}
+
+		void parse_options(Interface& interface, const unsigned char* p, size_t remaining) {
+			while (remaining >= 4) {
+				uint16_t code = read16(p);
+				uint16_t length = read16(p + 2);
+				size_t padded = (static_cast<size_t>(length) + 3) / 4 * 4;
+				if (code == 0 || 4 + padded > remaining) {
+					return;
+				}
+				if (code == OPTION_TSRESOL && length >= 1) {
+					// high bit set: negative power of 2, else of 10
+					int exponent = p[4] & 0x7f;
+					if (p[4] & 0x80) {
+						interface.units_per_second = exponent < 64 ? 1ull << exponent : 1;
+					}
+					else {
+						interface.units_per_second = 1;
+						for (int i = 0; i < exponent && i < 19; i++) {
+							interface.units_per_second *= 10;
+						}
+					}
+				}
+				else if (code == OPTION_TSOFFSET && length >= 8) {
+					uint64_t value;
+					memcpy(&value, p + 4, sizeof(value));
+					interface.offset_seconds = static_cast<int64_t>(swapped ? __builtin_bswap64(value) : value);
+				}
+				p += 4 + padded;
+				remaining -= 4 + padded;
+			}
+		}
+
+		const unsigned char* data;
+		size_t size;
+		size_t offset = 0;
+		capture_format_t file_format;
+		bool swapped = false;
+		bool truncated = false;
+		// pcap
+		bool nanoseconds = false;
+		uint16_t pcap_link_type = LINKTYPE_ETHERNET;
+		// pcapng
+		std::vector<Interface> interfaces;
+		int64_t last_timestamp = 0;
+	};
+} // namespace cpp_socket::linklayer
+
+#endif // PCAP_READER_H
@@ -0,0 +1,265 @@
+#ifndef PCAP_REPLAY_H
+#define PCAP_REPLAY_H
+
+#include <linklayer/PacketView.h>
+#include <linklayer/PcapReader.h>
+#include <linklayer/RawSocket.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::linklayer {
+	enum pacing_t {
+		// gaps between frames as captured, divided by the rate (speed factor, 1 = real time)
+		ORIGINAL_TIMING,
+		// rate frames per second
+		FIXED_PPS,
+		// rate bits per second of frame data
+		FIXED_BPS,
+		// as fast as the socket takes them
+		MAX_SPEED
+	};
+
+	struct ReplayStats {
+		uint64_t packets = 0;
+		uint64_t bytes = 0;
+		// frames the socket refused with anything but a full queue
+		uint64_t send_errors = 0;
+		int64_t elapsed_ns = 0;
+		double packets_per_second = 0;
+		double bits_per_second = 0;
+		// how late frames left compared to their schedule, 0 for MAX_SPEED
+		int64_t mean_pacing_error_ns = 0;
+		int64_t max_pacing_error_ns = 0;
+	};
+
+	/*
+	Replays a capture through a RawSocket. Frames are sent straight from the mapped
+	file (copied only to rewrite them), frames that are due together go out in one
+	sendmmsg call. Waits longer than SLEEP_THRESHOLD_NS sleep until shortly before
+	the deadline and spin the rest, so pacing stays within microseconds without
+	burning a core on slow rates.
+	*/
+	class PcapReplay {
+	public:
+		// the frame was copied and can be changed in place, e.g. with the PacketView setters
+		using rewrite_t = std::function<void(PacketView&)>;
+
+		PcapReplay(RawSocket& socket, PcapReader& reader)
+			:socket(socket), reader(reader) {
+
+		}
+
+		PcapReplay(const PcapReplay&) = delete;
+		PcapReplay& operator=(const PcapReplay&) = delete;
+
+		/*
+		- rate: speed factor for ORIGINAL_TIMING, frames or bits per second for FIXED_PPS
+		  and FIXED_BPS, ignored for MAX_SPEED.
+		*/
+		void set_pacing(pacing_t mode, double rate = 1) {
+			pacing = mode;
+			this->rate = rate > 0 ? rate : 1;
+		}
+
+		// times to play the capture, 0 repeats until stop()
+		void set_loops(int loops) {
+			this->loops = loops;
+		}
+
+		// frames per sendmmsg call at most
+		void set_batch_size(int size) {
+			batch_size = std::clamp(size, 1, MAX_BATCH);
+		}
+
+		void set_rewrite(rewrite_t rewrite) {
+			this->rewrite = std::move(rewrite);
+		}
+
+		// makes run() return after the current batch, safe to call from any thread
+		void stop() {
+			stopping.store(true, std::memory_order_relaxed);
+		}
+
+		/*
+		Plays the capture on the calling thread until all loops are done or stop() is called.
+		- Returns the stats of this run, frames the socket refused are counted, not retried.
+		*/
+		ReplayStats run() {
+			stats = ReplayStats{};
+			stopping.store(false, std::memory_order_relaxed);
+			if (rewrite && scratch.empty()) {
+				scratch.resize(static_cast<size_t>(MAX_BATCH) * MAX_FRAME_SIZE);
+			}
+			int64_t start = now();
+			// nanoseconds after start, kept fractional so fixed rates do not drift
+			double schedule = 0;
+			int64_t capture_start;
+			int64_t loop_start = start;
+			int64_t error_sum = 0;
+			int count = 0;
+			iovec frames[MAX_BATCH];
+			int64_t deadlines[MAX_BATCH];
+
+			for (int loop = 0; (loops == 0 || loop < loops) && !stopping.load(std::memory_order_relaxed); loop++) {
+				reader.rewind();
+				capture_start = -1;
+				int64_t last_due = loop_start;
+				uint64_t played = 0;
+				CapturedFrame frame;
+				while (!stopping.load(std::memory_order_relaxed) && reader.next(frame)) {
+					int64_t due = deadline(frame, start, schedule, capture_start, loop_start);
+					last_due = due;
+					played++;
+					if (count > 0 && (count == batch_size || due > now())) {
+						error_sum += send(frames, deadlines, count);
+						count = 0;
+					}
+					if (pacing != MAX_SPEED) {
+						wait_until(due);
+					}
+					unsigned char* data = const_cast<unsigned char*>(frame.data);
+					size_t size = frame.size;
+					if (rewrite) {
+						size = std::min<size_t>(size, MAX_FRAME_SIZE);
+						data = scratch.data() + static_cast<size_t>(count) * MAX_FRAME_SIZE;
+						memcpy(data, frame.data, size);
+						PacketView view(data, size);
+						rewrite(view);
+					}
+					frames[count].iov_base = data;
+					frames[count].iov_len = size;
+					deadlines[count] = due;
+					count++;
+				}
+				// the next pass starts right after the last frame of this one
+				loop_start = last_due;
+				if (played == 0) {
+					break;
+				}
+			}
+			if (count > 0) {
+				error_sum += send(frames, deadlines, count);
+			}
+
+			stats.elapsed_ns = now() - start;
+			if (stats.elapsed_ns > 0) {
+				stats.packets_per_second = stats.packets * 1e9 / stats.elapsed_ns;
+				stats.bits_per_second = stats.bytes * 8e9 / stats.elapsed_ns;
+			}
+			if (pacing != MAX_SPEED && stats.packets > 0) {
+				stats.mean_pacing_error_ns = error_sum / static_cast<int64_t>(stats.packets);
+			}
+			return stats;
+		}
+	private:
+		static constexpr int MAX_BATCH = 64;
+		static constexpr size_t MAX_FRAME_SIZE = 65536;
+		static constexpr int64_t SLEEP_THRESHOLD_NS = 100000;
+		static constexpr int64_t SPIN_NS = 50000;
+
+		static int64_t now() {
+			timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+		}
+
+		static void wait_until(int64_t due) {
+			int64_t remaining = due - now();
+			if (remaining > SLEEP_THRESHOLD_NS) {
+				int64_t wake = due - SPIN_NS;
+				timespec ts{static_cast<time_t>(wake / 1000000000), static_cast<long>(wake % 1000000000)};
+				while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+
+				}
+			}
+			while (now() < due) {
+
+			}
+		}
+
+		/*
+		Schedule of the next frame. schedule is where FIXED_PPS/FIXED_BPS stand, it moves
+		by one frame slot per call; ORIGINAL_TIMING follows the capture timestamps.
+		*/
+		int64_t deadline(const CapturedFrame& frame, int64_t start, double& schedule, int64_t& capture_start, int64_t loop_start) {
+			switch (pacing) {
+				case ORIGINAL_TIMING: {
+					if (capture_start == -1) {
+						capture_start = frame.timestamp_ns;
+					}
+					int64_t offset = std::max<int64_t>(frame.timestamp_ns - capture_start, 0);
+					return loop_start + static_cast<int64_t>(offset / rate);
+				}
+				case FIXED_PPS: {
+					int64_t due = start + static_cast<int64_t>(schedule);
+					schedule += 1e9 / rate;
+					return due;
+				}
+				case FIXED_BPS: {
+					int64_t due = start + static_cast<int64_t>(schedule);
+					schedule += frame.size * 8e9 / rate;
+					return due;
+				}
+				default:
+					return 0;
+			}
+		}
+
+		/*
+		Sends the batch, retrying while the device queue is full (ENOBUFS/EAGAIN).
+		- Returns the summed pacing error of the frames sent.
+		*/
+		int64_t send(iovec* frames, const int64_t* deadlines, int count) {
+			int64_t error_sum = 0;
+			int sent = 0;
+			while (sent < count) {
+				int r = socket.send_frames(frames + sent, count - sent);
+				if (r < 0) {
+					if (errno == ENOBUFS || errno == WOULDBLOCK_ERROR) {
+						continue;
+					}
+					// drop the frame that failed and go on with the rest
+					stats.send_errors++;
+					sent++;
+					continue;
+				}
+				int64_t sent_at = now();
+				for (int i = sent; i < sent + r; i++) {
+					stats.packets++;
+					stats.bytes += frames[i].iov_len;
+					if (pacing != MAX_SPEED) {
+						int64_t error = std::max<int64_t>(sent_at - deadlines[i], 0);
+						error_sum += error;
+						stats.max_pacing_error_ns = std::max(stats.max_pacing_error_ns, error);
+					}
+				}
+				sent += r;
+			}
+			return error_sum;
+		}
+
+		RawSocket& socket;
+		PcapReader& reader;
+		pacing_t pacing = ORIGINAL_TIMING;
+		double rate = 1;
+		int loops = 1;
+		int batch_size = 32;
+		rewrite_t rewrite;
+		std::vector<unsigned char> scratch;
+		std::atomic<bool> stopping = false;
+		ReplayStats stats;
+	};
+} // namespace cpp_socket::linklayer
+
+#endif // PCAP_REPLAY_H
@@ -0,0 +1,391 @@
+#ifndef PCAP_WRITER_H
+#define PCAP_WRITER_H
+
+#include <base/LockFreeQueue.h>
+#include <base/Timestamping.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using cpp_socket::base::PacketTimestamps;
+using cpp_socket::base::SpscQueue;
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::linklayer {
+	enum capture_format_t {
+		// classic pcap with the nanosecond magic
+		PCAP,
+		// pcapng, one section and interface per file, if_tsresol of nanoseconds
+		PCAPNG
+	};
+
+	// LINKTYPE_ETHERNET
+	inline constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+	inline constexpr uint32_t PCAP_MAGIC_NANOSECONDS = 0xa1b23c4d;
+	inline constexpr uint32_t PCAP_MAGIC_MICROSECONDS = 0xa1b2c3d4;
+	inline constexpr size_t PCAP_FILE_HEADER_SIZE = 24;
+	inline constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+	inline constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0a0d0d0a;
+	inline constexpr uint32_t PCAPNG_INTERFACE_DESCRIPTION = 1;
+	inline constexpr uint32_t PCAPNG_ENHANCED_PACKET = 6;
+	inline constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+
+	/*
+	Streaming capture sink. write() only copies the frame into a large aligned buffer,
+	full buffers are handed to a writer thread through a lock-free queue and written
+	to disk in one call each, so the receive thread never waits for the disk. If all
+	buffers are waiting for the disk the frame is dropped and counted instead.
+	Files are rotated at a size limit, each file is complete on its own.
+	write() and flush() are meant for a single receive thread.
+	*/
+	class PcapWriter {
+	public:
+		/*
+		- path: with rotation, the index is inserted before the extension (capture_0001.pcapng).
+		- max_file_bytes: rotate once a file would grow past it, 0 writes a single file.
+		- buffer_size: bytes per write, at least snaplen plus record overhead.
+		- buffers: buffers in flight, the disk may fall behind by buffers * buffer_size bytes.
+		- Throws if the first file cannot be created.
+		*/
+		PcapWriter(std::string path, capture_format_t format = PCAPNG, uint32_t snaplen = 65535,
+			size_t max_file_bytes = 0, size_t buffer_size = 4 << 20, int buffers = 8, uint16_t link_type = LINKTYPE_ETHERNET)
+			:path(std::move(path)), format(format), snaplen(snaplen), max_file_bytes(max_file_bytes),
+			buffer_size(round_up(std::max<size_t>(buffer_size, snaplen + MAX_RECORD_OVERHEAD + MAX_FILE_HEADER_SIZE), ALIGNMENT)),
+			link_type(link_type), free_buffers(buffers), full_buffers(buffers) {
+			if (buffers <= 0) {
+				throw std::runtime_error("At least one buffer is required.");
+			}
+			for (int i = 0; i < buffers; i++) {
+				unsigned char* data = static_cast<unsigned char*>(std::aligned_alloc(ALIGNMENT, this->buffer_size));
+				if (data == nullptr) {
+					throw std::runtime_error("Failed to allocate capture buffer.");
+				}
+				storage.push_back(std::unique_ptr<Buffer>(new Buffer{data}));
+				free_buffers.try_push(storage.back().get());
+			}
+			if (!open_file()) {
+				throw std::runtime_error("Failed to create capture file.");
+			}
+			writer = std::thread([this] { write_buffers(); });
+		}
+
+		PcapWriter(const PcapWriter&) = delete;
+		PcapWriter& operator=(const PcapWriter&) = delete;
+
+		// writes everything captured so far before returning
+		~PcapWriter() {
+			flush();
+			stopping = true;
+			sealed.fetch_add(1, std::memory_order_release);
+			sealed.notify_one();
+			writer.join();
+			if (fd != -1) {
+				close(fd);
+			}
+		}
+
+		/*
+		- frame: captured bytes, cut to snaplen.
+		- timestamp_ns: nanoseconds since the epoch.
+		- original_size: size on the wire if the frame was already truncated, 0 for size.
+		- Returns false if the frame was dropped because the writer fell behind.
+		*/
+		bool write(const void* frame, size_t size, int64_t timestamp_ns, size_t original_size = 0) {
+			size_t captured = std::min<size_t>(size, snaplen);
+			size_t record = record_size(captured);
+			if (max_file_bytes > 0 && file_bytes > header_size() && file_bytes + record > max_file_bytes) {
+				rotate();
+			}
+			if (current == nullptr || current->used + record + (need_header ? header_size() : 0) > buffer_size) {
+				seal();
+				if (!free_buffers.try_pop(current)) {
+					current = nullptr;
+					dropped++;
+					return false;
+				}
+			}
+			if (need_header) {
+				current->first_in_file = true;
+				current->used += encode_header(current->data + current->used);
+				file_bytes = header_size();
+				need_header = false;
+			}
+			current->used += encode_record(current->data + current->used, frame, captured,
+				original_size > 0 ? original_size : size, timestamp_ns);
+			file_bytes += record;
+			packets++;
+			return true;
+		}
+
+		// timestamped by the NIC if available, the kernel otherwise, and now if neither
+		bool write(const void* frame, size_t size, const PacketTimestamps& timestamps, size_t original_size = 0) {
+			int64_t timestamp = timestamps.has_hardware ? PacketTimestamps::to_ns(timestamps.hardware)
+				: timestamps.has_software ? PacketTimestamps::to_ns(timestamps.software) : PacketTimestamps::now_ns();
+			return write(frame, size, timestamp, original_size);
+		}
+
+		/*
+		Hands the partly filled buffer to the writer thread, call it periodically when
+		traffic is low so captured frames reach the disk in time.
+		*/
+		void flush() {
+			seal();
+		}
+
+		uint64_t packet_count() {
+			return packets;
+		}
+
+		// frames lost because all buffers were waiting for the disk
+		uint64_t dropped_count() {
+			return dropped;
+		}
+
+		// bytes written to disk, safe to call from any thread
+		uint64_t written_bytes() {
+			return written.load(std::memory_order_relaxed);
+		}
+
+		// writes that failed, the buffer is lost
+		uint64_t write_error_count() {
+			return write_errors.load(std::memory_order_relaxed);
+		}
+
+		// files created so far, safe to call from any thread
+		int file_count() {
+			return files.load(std::memory_order_relaxed);
+		}
+	private:
+		static constexpr size_t ALIGNMENT = 4096;
+		static constexpr size_t PCAPNG_SECTION_HEADER_SIZE = 28;
+		static constexpr size_t PCAPNG_INTERFACE_DESCRIPTION_SIZE = 32;
+		static constexpr size_t PCAPNG_PACKET_OVERHEAD = 32;
+		static constexpr size_t MAX_RECORD_OVERHEAD = PCAPNG_PACKET_OVERHEAD + 3;
+		static constexpr size_t MAX_FILE_HEADER_SIZE = PCAPNG_SECTION_HEADER_SIZE + PCAPNG_INTERFACE_DESCRIPTION_SIZE;
+
+		struct Buffer {
+			unsigned char* data;
+			size_t used = 0;
+			// starts with the file header, the writer switches to the next file first
+			bool first_in_file = false;
+
+			~Buffer() {
+				std::free(data);
+			}
+		};
+
+		static size_t round_up(size_t value, size_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		size_t header_size() {
+			return format == PCAP ? PCAP_FILE_HEADER_SIZE : PCAPNG_SECTION_HEADER_SIZE + PCAPNG_INTERFACE_DESCRIPTION_SIZE;
+		}
+
+		size_t record_size(size_t captured) {
+			return format == PCAP ? PCAP_RECORD_HEADER_SIZE + captured : PCAPNG_PACKET_OVERHEAD + round_up(captured, 4);
+		}
+
+		template <typename T>
+		static unsigned char* put(unsigned char* p, T value) {
+			memcpy(p, &value, sizeof(value));
+			return p + sizeof(value);
+		}
+
+		// written in host byte order, readers detect it from the magic
+		size_t encode_header(unsigned char* p) {
+			unsigned char* start = p;
+			if (format == PCAP) {
+				p = put<uint32_t>(p, PCAP_MAGIC_NANOSECONDS);
+				p = put<uint16_t>(p, 2);
+				p = put<uint16_t>(p, 4);
+				p = put<int32_t>(p, 0);
+				p = put<uint32_t>(p, 0);
+				p = put<uint32_t>(p, snaplen);
+				p = put<uint32_t>(p, link_type);
+				return p - start;
+			}
+			p = put<uint32_t>(p, PCAPNG_SECTION_HEADER);
+			p = put<uint32_t>(p, PCAPNG_SECTION_HEADER_SIZE);
+			p = put<uint32_t>(p, PCAPNG_BYTE_ORDER_MAGIC);
+			p = put<uint16_t>(p, 1);
+			p = put<uint16_t>(p, 0);
+			// section length unknown
+			p = put<int64_t>(p, -1);
+			p = put<uint32_t>(p, PCAPNG_SECTION_HEADER_SIZE);
+
+			p = put<uint32_t>(p, PCAPNG_INTERFACE_DESCRIPTION);
+			p = put<uint32_t>(p, PCAPNG_INTERFACE_DESCRIPTION_SIZE);
+			p = put<uint16_t>(p, link_type);
+			p = put<uint16_t>(p, 0);
+			p = put<uint32_t>(p, snaplen);
+			// if_tsresol: 10^-9
+			p = put<uint16_t>(p, 9);
+			p = put<uint16_t>(p, 1);
+			p = put<uint32_t>(p, 9);
+			// opt_endofopt
+			p = put<uint32_t>(p, 0);
+			p = put<uint32_t>(p, PCAPNG_INTERFACE_DESCRIPTION_SIZE);
+			return p - start;
+		}
+
+		size_t encode_record(unsigned char* p, const void* frame, size_t captured, size_t original, int64_t timestamp_ns) {
+			if (format == PCAP) {
+				p = put<uint32_t>(p, static_cast<uint32_t>(timestamp_ns / 1000000000));
+				p = put<uint32_t>(p, static_cast<uint32_t>(timestamp_ns % 1000000000));
+				p = put<uint32_t>(p, static_cast<uint32_t>(captured));
+				p = put<uint32_t>(p, static_cast<uint32_t>(original));
+				memcpy(p, frame, captured);
+				return PCAP_RECORD_HEADER_SIZE + captured;
+			}
+			uint32_t size = static_cast<uint32_t>(record_size(captured));
+			uint64_t timestamp = static_cast<uint64_t>(timestamp_ns);
+			p = put<uint32_t>(p, PCAPNG_ENHANCED_PACKET);
+			p = put<uint32_t>(p, size);
+			// interface id
+			p = put<uint32_t>(p, 0);
+			p = put<uint32_t>(p, static_cast<uint32_t>(timestamp >> 32));
+			p = put<uint32_t>(p, static_cast<uint32_t>(timestamp));
+			p = put<uint32_t>(p, static_cast<uint32_t>(captured));
+			p = put<uint32_t>(p, static_cast<uint32_t>(original));
+			memcpy(p, frame, captured);
+			size_t padded = round_up(captured, 4);
+			memset(p + captured, 0, padded - captured);
+			put<uint32_t>(p + padded, size);
+			return size;
+		}
+
+		// the next file starts in a fresh buffer
+		void rotate() {
+			seal();
+			need_header = true;
+			file_bytes = 0;
+		}
+
+		// hands the current buffer to the writer thread
+		void seal() {
+			if (current == nullptr || current->used == 0) {
+				return;
+			}
+			full_buffers.try_push(current);
+			current = nullptr;
+			sealed.fetch_add(1, std::memory_order_release);
+			sealed.notify_one();
+		}
+
+		void write_buffers() {
+			while (true) {
+				uint64_t seen = sealed.load(std::memory_order_acquire);
+				Buffer* buffer;
+				if (full_buffers.try_pop(buffer)) {
+					if (buffer->first_in_file && file_has_data) {
+						if (fd != -1) {
+							close(fd);
+						}
+						open_file();
+					}
+					write_all(buffer->data, buffer->used);
+					file_has_data = true;
+					buffer->used = 0;
+					buffer->first_in_file = false;
+					free_buffers.try_push(buffer);
+					continue;
+				}
+				if (stopping) {
+					return;
+				}
+				sealed.wait(seen, std::memory_order_acquire);
+			}
+		}
+
+		void write_all(const unsigned char* data, size_t size) {
+			if (fd == -1) {
+				write_errors.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			while (size > 0) {
+				ssize_t r = ::write(fd, data, size);
+				if (r < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					write_errors.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				data += r;
+				size -= r;
+				written.fetch_add(r, std::memory_order_relaxed);
+			}
+		}
+
+		// rotated files get their blocks reserved up front, so the disk is not fragmented while they grow
+		bool open_file() {
+			std::string name = path;
+			if (max_file_bytes > 0) {
+				char index[16];
+				snprintf(index, sizeof(index), "_%04d", files.load(std::memory_order_relaxed));
+				size_t dot = name.find_last_of('.');
+				size_t slash = name.find_last_of('/');
+				if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+					dot = name.size();
+				}
+				name.insert(dot, index);
+			}
+			fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd == -1) {
+				return false;
+			}
+			if (max_file_bytes > 0) {
+				fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, max_file_bytes);
+			}
+			files.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		std::string path;
+		capture_format_t format;
+		uint32_t snaplen;
+		size_t max_file_bytes;
+		size_t buffer_size;
+		uint16_t link_type;
+
+		// receive thread side
+		std::vector<std::unique_ptr<Buffer>> storage;
+		Buffer* current = nullptr;
+		bool need_header = true;
+		size_t file_bytes = 0;
+		uint64_t packets = 0;
+		uint64_t dropped = 0;
+
+		SpscQueue<Buffer*> free_buffers;
+		SpscQueue<Buffer*> full_buffers;
+		std::atomic<uint64_t> sealed = 0;
+		std::atomic<bool> stopping = false;
+
+		// writer thread side
+		std::thread writer;
+		int fd = -1;
+		bool file_has_data = false;
+		std::atomic<uint64_t> written = 0;
+		std::atomic<uint64_t> write_errors = 0;
+		std::atomic<int> files = 0;
+	};
+} // namespace cpp_socket::linklayer
+
+#endif // PCAP_WRITER_H
@@ -2,9 +2,11 @@
 #define RAW_SOCKET_H
 
 #include <base/SocketWrapper.h>
+#include <linklayer/PacketView.h>
 #include <linux/ethtool.h>
 #include <sys/ioctl.h>
 #include <linux/sockios.h>
+#include <algorithm>
 #include <cstring>
 
 using cpp_socket::base::SocketWrapper;
@@ -21,6 +23,45 @@ namespace cpp_socket::linklayer {
 		IPV4_FILTER = ETH_P_IP
 	};
 
+	/*
+	struct virtio_net_hdr, linux/virtio_net.h does not compile as C++.
+	Fields are in host byte order on packet sockets.
+	*/
+	struct vnet_header_t {
+		uint8_t flags;
+		uint8_t gso_type;
+		// ethernet, IP and transport headers
+		uint16_t hdr_len;
+		// payload bytes per segment
+		uint16_t gso_size;
+		uint16_t csum_start;
+		uint16_t csum_offset;
+	};
+
+	enum vnet_flag_t {
+		VNET_NEEDS_CSUM = 1,
+		VNET_DATA_VALID = 2
+	};
+
+	enum vnet_gso_t {
+		VNET_GSO_NONE = 0,
+		VNET_GSO_TCPV4 = 1,
+		VNET_GSO_TCPV6 = 4,
+		VNET_GSO_UDP_L4 = 5,
+		VNET_GSO_ECN = 0x80
+	};
+
+	// PACKET_FANOUT_* modes of linux/if_packet.h, which clashes with netpacket/packet.h
+	enum fanout_t {
+		FANOUT_HASH = 0,
+		FANOUT_LOAD_BALANCE = 1,
+		FANOUT_CPU = 2,
+		FANOUT_ROLLOVER = 3,
+		FANOUT_RANDOM = 4,
+		FANOUT_QUEUE_MAPPING = 5,
+		FANOUT_FLAG_DEFRAG = 0x8000
+	};
+
 	class RawSocket: public SocketWrapper {
 	public:
 		RawSocket(std::string ifname, protocol_t filter, bool blocking) 
@@ -118,6 +159,211 @@ namespace cpp_socket::linklayer {
             return mtu;
         }
 
+        /**
+         * @brief Configure the NIC to timestamp all received and sent packets in hardware,
+         * combine with enable_timestamping(RX_HARDWARE_TIMESTAMPS | TX_HARDWARE_TIMESTAMPS)
+         * 
+         * @return int -1 if the driver does not support hardware timestamping
+         */
+        int enable_hardware_timestamping() {
+            struct hwtstamp_config config{};
+            config.tx_type = HWTSTAMP_TX_ON;
+            config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+            struct ifreq ifr{};
+            std::strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+            ifr.ifr_data = reinterpret_cast<char*>(&config);
+
+            return ioctl(m_socket, SIOCSHWTSTAMP, &ifr);
+        }
+
+        /**
+         * @brief virtio-net header mode (PACKET_VNET_HDR), every frame is preceded by a vnet_header_t.
+         * Received frames can be GRO super-frames of up to 64 KB whose checksum is only partial
+         * (VNET_NEEDS_CSUM), and sent frames can be up to 64 KB with a GSO header,
+         * the kernel or the NIC segments them and fills in the checksums. Use receive_vnet and send_vnet
+         * afterwards, the plain wrappers would read or write the header as frame data.
+         * 
+         * @param enable 
+         * @return int -1 if the kernel refused, e.g. after a ring was set up
+         */
+        int enable_vnet_header(bool enable) {
+            int flag = enable ? 1 : 0;
+            if (setsockopt(m_socket, SOL_PACKET, PACKET_VNET_HDR, &flag, sizeof(flag)) == -1) {
+                return -1;
+            }
+            vnet_header = enable;
+            return 0;
+        }
+
+        bool is_vnet_header_enabled() {
+            return vnet_header;
+        }
+
+        /**
+         * @brief Receives a frame and its vnet header in one call
+         * 
+         * @param frame buffer, 65535 bytes hold any super-frame
+         * @param size 
+         * @param header gso and checksum state of the frame
+         * @param flags recv flags
+         * @return int size of the frame, -1 on syscall error
+         */
+        int receive_vnet(unsigned char* frame, size_t size, vnet_header_t& header, int flags = 0) {
+            iovec iov[2];
+            set_iovec(iov[0], &header, sizeof(header));
+            set_iovec(iov[1], frame, size);
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 2;
+            int r = recvmsg(m_socket, &msg, flags);
+            if (r < 0) {
+                return r;
+            }
+            if (static_cast<size_t>(r) < sizeof(header)) {
+                errno = INVAL_ARGUMENT;
+                return -1;
+            }
+            return r - static_cast<int>(sizeof(header));
+        }
+
+        /**
+         * @brief Sends a frame with its vnet header in one call
+         * 
+         * @return int size of the frame sent, -1 on syscall error (EINVAL if the header does not match the frame)
+         */
+        int send_vnet(const unsigned char* frame, size_t size, const vnet_header_t& header, int flags = 0) {
+            iovec iov[2];
+            set_iovec(iov[0], &header, sizeof(header));
+            set_iovec(iov[1], frame, size);
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 2;
+            int r = sendmsg(m_socket, &msg, flags);
+            if (r < 0) {
+                return r;
+            }
+            return r - static_cast<int>(sizeof(header));
+        }
+
+        /**
+         * @brief Fills a vnet header to send a TCP (or UDP) super-frame as segments of mss payload bytes,
+         * with the transport checksum left to the kernel or NIC. The IP header must hold the length
+         * of the whole super-frame, the transport checksum field is set to the pseudo header sum
+         * as the offload expects.
+         * 
+         * @param packet parsed super-frame, its buffer is modified
+         * @param mss payload bytes per segment
+         * @param header 
+         * @return true if the frame is TCP or UDP over IPv4/IPv6
+         */
+        static bool prepare_gso(PacketView& packet, uint16_t mss, vnet_header_t& header) {
+            header = vnet_header_t{};
+            unsigned char* l4;
+            size_t header_size;
+            size_t payload_size;
+            bool ipv4 = packet.ipv4().valid();
+            if (packet.tcp().valid()) {
+                l4 = packet.tcp().payload() - packet.tcp().header_length();
+                header_size = packet.tcp().header_length();
+                payload_size = packet.tcp().payload_size();
+                header.gso_type = ipv4 ? VNET_GSO_TCPV4 : VNET_GSO_TCPV6;
+                header.csum_offset = 16;
+            }
+            else if (packet.udp().valid()) {
+                l4 = packet.udp().payload() - UdpView::HEADER_SIZE;
+                header_size = UdpView::HEADER_SIZE;
+                payload_size = packet.udp().payload_size();
+                header.gso_type = VNET_GSO_UDP_L4;
+                header.csum_offset = 6;
+            }
+            else {
+                return false;
+            }
+
+            unsigned char* frame = packet.ethernet().destination();
+            header.flags = VNET_NEEDS_CSUM;
+            header.csum_start = static_cast<uint16_t>(l4 - frame);
+            header.hdr_len = static_cast<uint16_t>(header.csum_start + header_size);
+            if (payload_size > mss) {
+                header.gso_size = mss;
+            }
+            else {
+                header.gso_type = VNET_GSO_NONE;
+            }
+            // partial checksum: the folded pseudo header sum, not complemented
+            uint16_t partial = checksum_fold(packet.pseudo_header_sum());
+            memcpy(l4 + header.csum_offset, &partial, sizeof(partial));
+            return true;
+        }
+
+        /**
+         * @brief A received frame whose transport checksum is partial or already checked by the kernel/NIC,
+         * verifying it in software would fail or be wasted work
+         */
+        static bool is_checksum_offloaded(const vnet_header_t& header) {
+            return header.flags & (VNET_NEEDS_CSUM | VNET_DATA_VALID);
+        }
+
+        /**
+         * @brief Sends frames with as few sendmmsg calls as possible
+         *
+         * @param frames one iovec per frame
+         * @param count
+         * @param flags send flags
+         * @return int number of frames sent, less than count if the socket buffer filled up,
+         * -1 if not even the first one could be sent
+         */
+        int send_frames(const iovec* frames, int count, int flags = 0) {
+            int sent = 0;
+            while (sent < count) {
+                int n = std::min(count - sent, MAX_BATCH);
+                mmsghdr messages[MAX_BATCH];
+                for (int i = 0; i < n; i++) {
+                    messages[i].msg_hdr = msghdr{};
+                    messages[i].msg_hdr.msg_iov = const_cast<iovec*>(&frames[sent + i]);
+                    messages[i].msg_hdr.msg_iovlen = 1;
+                    messages[i].msg_len = 0;
+                }
+                int r = sendmmsg(m_socket, messages, n, flags);
+                if (r < 0) {
+                    return sent > 0 ? sent : -1;
+                }
+                sent += r;
+                if (r < n) {
+                    break;
+                }
+            }
+            return sent;
+        }
+
+        /**
+         * @brief Sent frames skip the qdisc layer and go straight to the driver queue (PACKET_QDISC_BYPASS),
+         * cheaper per frame but without traffic shaping, and the socket sees ENOBUFS when the queue is full
+         *
+         * @param enable
+         * @return int -1 on syscall error
+         */
+        int set_qdisc_bypass(bool enable) {
+            int flag = enable ? 1 : 0;
+            return setsockopt(m_socket, SOL_PACKET, PACKET_QDISC_BYPASS, &flag, sizeof(flag));
+        }
+
+        /**
+         * @brief Joins a fanout group (PACKET_FANOUT): the sockets of a group bound to the same interface
+         * share its traffic instead of each receiving a copy. With FANOUT_HASH both directions of
+         * a flow go to the same socket, so one capture thread per socket can keep per flow state unshared.
+         *
+         * @param group id shared by the sockets of the group
+         * @param mode FANOUT_HASH, FANOUT_CPU, ... optionally | FANOUT_FLAG_DEFRAG to hash fragments
+         * by their reassembled packet
+         * @return int -1 on syscall error (EINVAL if the group exists with another mode)
+         */
+        int set_fanout(uint16_t group, int mode = FANOUT_HASH) {
+            int value = group | (mode << 16);
+            return setsockopt(m_socket, SOL_PACKET, PACKET_FANOUT, &value, sizeof(value));
+        }
+
         std::string get_mac_str() {
             std::string mac;
             struct ifreq ifr{};
@@ -135,7 +381,10 @@ namespace cpp_socket::linklayer {
             return mac;
         }
 	private:
+        static constexpr int MAX_BATCH = 64;
+
         std::string ifname;
+        bool vnet_header = false;
 		Address createAddress(std::string ifname, protocol_t filter) {
 			Address address(RAW_PACKET);
 			address.set_address(ifname, filter);
@@ -0,0 +1,273 @@
+#ifndef TUN_TAP_DEVICE_H
+#define TUN_TAP_DEVICE_H
+
+#include <linklayer/RawSocket.h>
+#include <fcntl.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::linklayer {
+	enum tuntap_mode_t {
+		// IP packets, no link layer header
+		TUN_DEVICE = IFF_TUN,
+		// Ethernet frames
+		TAP_DEVICE = IFF_TAP
+	};
+
+	/*
+	Offloads for set_offloads, TUN_F_* of linux/if_tun.h (older headers lack the USO flags).
+	The kernel then hands over frames with partial checksums (VNET_NEEDS_CSUM) and TCP/UDP
+	super-frames of up to 64 KB, and takes them from the device the same way.
+	*/
+	enum tun_offload_t {
+		TUN_OFFLOAD_CSUM = 0x01,
+		TUN_OFFLOAD_TSO4 = 0x02,
+		TUN_OFFLOAD_TSO6 = 0x04,
+		TUN_OFFLOAD_TSO_ECN = 0x08,
+		TUN_OFFLOAD_USO4 = 0x20,
+		TUN_OFFLOAD_USO6 = 0x40
+	};
+
+	/*
+	TUN or TAP interface backed by this process, the userspace side of a VPN or
+	switch. With more than one queue (IFF_MULTI_QUEUE) the kernel spreads flows over
+	one file descriptor per queue, give each worker thread its own queue. A queue fd
+	can be added to an EventLoop. The device disappears when it is destroyed unless
+	it was made persistent.
+
+	With vnet headers every frame read or written is preceded by a vnet_header_t as on
+	a RawSocket in PACKET_VNET_HDR mode, use the *_vnet functions then.
+	*/
+	class TunTapDevice {
+	public:
+		/*
+		- name: interface name, empty or with %d (tun%d) to let the kernel pick one.
+		- queues: file descriptors to open, each with its own kernel queue.
+		- vnet_header: IFF_VNET_HDR, needed for set_offloads.
+		- Throws if the device cannot be created, e.g. without CAP_NET_ADMIN.
+		*/
+		TunTapDevice(std::string name, tuntap_mode_t mode, int queues = 1, bool vnet_header = false, bool blocking = false)
+			:mode(mode), vnet_header(vnet_header) {
+			if (queues < 1) {
+				throw std::runtime_error("At least one queue is required.");
+			}
+			for (int i = 0; i < queues; i++) {
+				int fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC | (blocking ? 0 : O_NONBLOCK));
+				if (fd == -1) {
+					close_queues();
+					throw std::runtime_error("Failed to open /dev/net/tun.");
+				}
+				struct ifreq ifr{};
+				ifr.ifr_flags = mode | IFF_NO_PI | (queues > 1 ? IFF_MULTI_QUEUE : 0) | (vnet_header ? IFF_VNET_HDR : 0);
+				strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+				if (ioctl(fd, TUNSETIFF, &ifr) == -1) {
+					close(fd);
+					close_queues();
+					throw std::runtime_error("Failed to create tun/tap device.");
+				}
+				fds.push_back(fd);
+				// the other queues attach to the name the kernel picked
+				name = ifr.ifr_name;
+			}
+			ifname = name;
+			if (vnet_header) {
+				int size = sizeof(vnet_header_t);
+				ioctl(fds[0], TUNSETVNETHDRSZ, &size);
+			}
+		}
+
+		TunTapDevice(const TunTapDevice&) = delete;
+		TunTapDevice& operator=(const TunTapDevice&) = delete;
+
+		~TunTapDevice() {
+			close_queues();
+		}
+
+		std::string get_ifname() {
+			return ifname;
+		}
+
+		tuntap_mode_t get_mode() {
+			return mode;
+		}
+
+		int queue_count() {
+			return static_cast<int>(fds.size());
+		}
+
+		int queue_fd(int queue) {
+			return fds[queue];
+		}
+
+		bool is_vnet_header_enabled() {
+			return vnet_header;
+		}
+
+		/*
+		Lets the kernel pass checksum and segmentation work to this process instead of
+		doing it itself, see tun_offload_t. Requires vnet headers.
+		- Returns -1 on syscall error.
+		*/
+		int set_offloads(unsigned int offloads) {
+			if (!vnet_header && offloads != 0) {
+				errno = EINVAL;
+				return -1;
+			}
+			return ioctl(fds[0], TUNSETOFFLOAD, offloads);
+		}
+
+		/*
+		A detached queue gets no packets, e.g. while its worker is idle or gone.
+		- Returns -1 on syscall error.
+		*/
+		int set_queue_enabled(int queue, bool enabled) {
+			struct ifreq ifr{};
+			ifr.ifr_flags = enabled ? IFF_ATTACH_QUEUE : IFF_DETACH_QUEUE;
+			return ioctl(fds[queue], TUNSETQUEUE, &ifr);
+		}
+
+		// a persistent device outlives the process, reopen it by name
+		int set_persistent(bool persistent) {
+			return ioctl(fds[0], TUNSETPERSIST, persistent ? 1 : 0);
+		}
+
+		// brings the interface up or down (IFF_UP), -1 on syscall error
+		int set_up(bool up) {
+			return interface_ioctl([up](int fd, ifreq& ifr) {
+				if (ioctl(fd, SIOCGIFFLAGS, &ifr) == -1) {
+					return -1;
+				}
+				ifr.ifr_flags = up ? (ifr.ifr_flags | IFF_UP) : (ifr.ifr_flags & ~IFF_UP);
+				return ioctl(fd, SIOCSIFFLAGS, &ifr);
+			});
+		}
+
+		int set_mtu(int mtu) {
+			return interface_ioctl([mtu](int fd, ifreq& ifr) {
+				ifr.ifr_mtu = mtu;
+				return ioctl(fd, SIOCSIFMTU, &ifr);
+			});
+		}
+
+		/*
+		- Returns the size of the frame, -1 on syscall error (EAGAIN if the queue is
+		  empty on a non-blocking device).
+		*/
+		int read_frame(int queue, unsigned char* frame, size_t size) {
+			return static_cast<int>(read(fds[queue], frame, size));
+		}
+
+		int write_frame(int queue, const unsigned char* frame, size_t size) {
+			return static_cast<int>(write(fds[queue], frame, size));
+		}
+
+		/*
+		- frame: 65535 bytes hold any super-frame.
+		- Returns the size of the frame without the header, -1 on syscall error.
+		*/
+		int read_vnet(int queue, unsigned char* frame, size_t size, vnet_header_t& header) {
+			iovec iov[2];
+			SocketWrapper::set_iovec(iov[0], &header, sizeof(header));
+			SocketWrapper::set_iovec(iov[1], frame, size);
+			int r = static_cast<int>(readv(fds[queue], iov, 2));
+			if (r < 0) {
+				return r;
+			}
+			if (static_cast<size_t>(r) < sizeof(header)) {
+				errno = EINVAL;
+				return -1;
+			}
+			return r - static_cast<int>(sizeof(header));
+		}
+
+		int write_vnet(int queue, const unsigned char* frame, size_t size, const vnet_header_t& header) {
+			iovec iov[2];
+			SocketWrapper::set_iovec(iov[0], &header, sizeof(header));
+			SocketWrapper::set_iovec(iov[1], frame, size);
+			int r = static_cast<int>(writev(fds[queue], iov, 2));
+			if (r < 0) {
+				return r;
+			}
+			return r - static_cast<int>(sizeof(header));
+		}
+
+		/*
+		Reads up to count frames, stopping when the queue is empty, so one readiness
+		event drains the queue. A tun fd has no recvmmsg, each frame is one read.
+		- buffers: one per frame, iov_len is the capacity.
+		- sizes: filled with the size of each frame read.
+		- headers: with vnet headers, filled per frame.
+		- Returns the number of frames read, -1 if none could be read (EAGAIN if the queue is empty).
+		*/
+		int read_batch(int queue, const iovec* buffers, int count, int* sizes, vnet_header_t* headers = nullptr) {
+			int n = 0;
+			for (; n < count; n++) {
+				unsigned char* buffer = static_cast<unsigned char*>(buffers[n].iov_base);
+				int r = vnet_header ? read_vnet(queue, buffer, buffers[n].iov_len, headers[n])
+					: read_frame(queue, buffer, buffers[n].iov_len);
+				if (r < 0) {
+					return n > 0 ? n : -1;
+				}
+				sizes[n] = r;
+			}
+			return n;
+		}
+
+		/*
+		- headers: with vnet headers, one per frame.
+		- Returns the number of frames written, -1 if none could be written.
+		*/
+		int write_batch(int queue, const iovec* frames, int count, const vnet_header_t* headers = nullptr) {
+			int n = 0;
+			for (; n < count; n++) {
+				const unsigned char* frame = static_cast<const unsigned char*>(frames[n].iov_base);
+				int r = vnet_header ? write_vnet(queue, frame, frames[n].iov_len, headers[n])
+					: write_frame(queue, frame, frames[n].iov_len);
+				if (r < 0) {
+					return n > 0 ? n : -1;
+				}
+			}
+			return n;
+		}
+	private:
+		template <typename F>
+		int interface_ioctl(F&& f) {
+			int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+			if (fd == -1) {
+				return -1;
+			}
+			struct ifreq ifr{};
+			strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+			int r = f(fd, ifr);
+			int error = errno;
+			close(fd);
+			errno = error;
+			return r;
+		}
+
+		void close_queues() {
+			for (int fd: fds) {
+				close(fd);
+			}
+			fds.clear();
+		}
+
+		std::string ifname;
+		tuntap_mode_t mode;
+		bool vnet_header;
+		std::vector<int> fds;
+	};
+} // namespace cpp_socket::linklayer
+
+#endif // TUN_TAP_DEVICE_H
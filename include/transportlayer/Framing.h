@@ -0,0 +1,163 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace cpp_socket::transportlayer {
+	/*
+	Selects the receive parser of BasicTcpSocket at compile time.
+	- LENGTH_PREFIXED: a header holding the payload size precedes every payload.
+	- DELIMITED: every payload is followed by a delimiter byte, payloads must not contain it.
+	- RAW_STREAM: no framing, every receive returns whatever bytes are available.
+	*/
+	enum framing_kind_t {
+		LENGTH_PREFIXED,
+		DELIMITED,
+		RAW_STREAM
+	};
+
+	/*
+	Framing policies for BasicTcpSocket and BasicSharedFrame. Every policy provides:
+	- KIND, MAX_HEADER_SIZE, MAX_TRAILER_SIZE, MAX_FRAME_SIZE and DEFAULT_MAX_FRAME_SIZE
+	- encode_header(size, header) and encode_trailer(trailer), returning the bytes written
+	Length prefixed policies also provide:
+	- header_bytes_needed(header, received), 0 once the header is complete
+	- decode_header(header, received), the payload size or INVALID_SIZE
+	Delimited policies provide DELIMITER.
+	*/
+	constexpr uint64_t INVALID_SIZE = std::numeric_limits<uint64_t>::max();
+
+	/*
+	Big endian size header of N bytes, FixedLengthFraming<4> is the default framing.
+	*/
+	template <size_t N>
+	struct FixedLengthFraming {
+		static_assert(N == 1 || N == 2 || N == 4 || N == 8, "Header size must be 1, 2, 4 or 8 bytes.");
+
+		static constexpr framing_kind_t KIND = LENGTH_PREFIXED;
+		static constexpr size_t MAX_HEADER_SIZE = N;
+		static constexpr size_t MAX_TRAILER_SIZE = 0;
+		// 4 byte headers stay within a signed int for compatibility with older peers
+		static constexpr uint64_t MAX_FRAME_SIZE = N == 8 ? std::numeric_limits<int64_t>::max()
+			: N == 4 ? 0x7fffffff : (uint64_t(1) << (8 * N)) - 1;
+		static constexpr uint64_t DEFAULT_MAX_FRAME_SIZE = MAX_FRAME_SIZE;
+
+		static size_t encode_header(uint64_t size, unsigned char* header) {
+			for (size_t i = 0; i < N; i++) {
+				header[i] = static_cast<unsigned char>(size >> (8 * (N - 1 - i)));
+			}
+			return N;
+		}
+
+		static size_t encode_trailer(unsigned char*) {
+			return 0;
+		}
+
+		static size_t header_bytes_needed(const unsigned char*, size_t received) {
+			return N - received;
+		}
+
+		static uint64_t decode_header(const unsigned char* header, size_t) {
+			uint64_t size = 0;
+			for (size_t i = 0; i < N; i++) {
+				size = size << 8 | header[i];
+			}
+			return size;
+		}
+	};
+
+	/*
+	LEB128 varint size header, 1 byte for payloads below 128 bytes, 2 below 16 KB.
+	The header is read one byte at a time so nothing past it is consumed.
+	*/
+	struct VarintFraming {
+		static constexpr framing_kind_t KIND = LENGTH_PREFIXED;
+		static constexpr size_t MAX_HEADER_SIZE = 10;
+		static constexpr size_t MAX_TRAILER_SIZE = 0;
+		static constexpr uint64_t MAX_FRAME_SIZE = std::numeric_limits<int64_t>::max();
+		static constexpr uint64_t DEFAULT_MAX_FRAME_SIZE = 0x7fffffff;
+
+		static size_t encode_header(uint64_t size, unsigned char* header) {
+			size_t i = 0;
+			while (size >= 0x80) {
+				header[i++] = static_cast<unsigned char>(size | 0x80);
+				size >>= 7;
+			}
+			header[i++] = static_cast<unsigned char>(size);
+			return i;
+		}
+
+		static size_t encode_trailer(unsigned char*) {
+			return 0;
+		}
+
+		static size_t header_bytes_needed(const unsigned char* header, size_t received) {
+			if (received == 0) {
+				return 1;
+			}
+			// a too long varint stops here and fails to decode
+			return (header[received - 1] & 0x80) && received < MAX_HEADER_SIZE ? 1 : 0;
+		}
+
+		static uint64_t decode_header(const unsigned char* header, size_t received) {
+			if (header[received - 1] & 0x80) {
+				return INVALID_SIZE;
+			}
+			uint64_t size = 0;
+			for (size_t i = 0; i < received; i++) {
+				size |= static_cast<uint64_t>(header[i] & 0x7f) << (7 * i);
+			}
+			return size > MAX_FRAME_SIZE ? INVALID_SIZE : size;
+		}
+	};
+
+	/*
+	Payloads terminated by D, e.g. line based protocols with '\n'.
+	The delimiter is stripped from received frames, sent payloads must not contain it.
+	*/
+	template <unsigned char D = '\n'>
+	struct DelimiterFraming {
+		static constexpr framing_kind_t KIND = DELIMITED;
+		static constexpr unsigned char DELIMITER = D;
+		static constexpr size_t MAX_HEADER_SIZE = 0;
+		static constexpr size_t MAX_TRAILER_SIZE = 1;
+		static constexpr uint64_t MAX_FRAME_SIZE = std::numeric_limits<int64_t>::max();
+		static constexpr uint64_t DEFAULT_MAX_FRAME_SIZE = 1024 * 1024;
+
+		static size_t encode_header(uint64_t, unsigned char*) {
+			return 0;
+		}
+
+		static size_t encode_trailer(unsigned char* trailer) {
+			trailer[0] = D;
+			return 1;
+		}
+	};
+
+	/*
+	No framing, frames are sent as is and every receive returns whatever bytes are
+	available, up to the maximum frame size (at most 64 KB per receive). Sends of any
+	size are accepted, the limit only applies to receiving.
+	*/
+	struct RawStreamFraming {
+		static constexpr framing_kind_t KIND = RAW_STREAM;
+		static constexpr size_t MAX_HEADER_SIZE = 0;
+		static constexpr size_t MAX_TRAILER_SIZE = 0;
+		static constexpr uint64_t MAX_FRAME_SIZE = std::numeric_limits<int64_t>::max();
+		static constexpr uint64_t DEFAULT_MAX_FRAME_SIZE = 65536;
+
+		static size_t encode_header(uint64_t, unsigned char*) {
+			return 0;
+		}
+
+		static size_t encode_trailer(unsigned char*) {
+			return 0;
+		}
+	};
+
+	using DefaultFraming = FixedLengthFraming<4>;
+} // namespace cpp_socket::transportlayer
+
+#endif // FRAMING_H
@@ -0,0 +1,100 @@
+#ifndef SHARED_FRAME_H
+#define SHARED_FRAME_H
+
+#include <transportlayer/Framing.h>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace cpp_socket::transportlayer {
+	/*
+	Immutable, reference counted frame (encoded header + payload + trailer) that can be
+	queued on any number of sockets using the same framing at once. The payload is never
+	copied, sockets send straight from the shared storage and it is released once the
+	last socket is done with it.
+	*/
+	template <typename Framing>
+	class BasicSharedFrame {
+	public:
+		static constexpr uint64_t MAX_PAYLOAD_SIZE = Framing::MAX_FRAME_SIZE;
+
+		BasicSharedFrame() = default;
+
+		/*
+		- Throws if the payload is bigger than MAX_PAYLOAD_SIZE.
+		*/
+		explicit BasicSharedFrame(std::vector<unsigned char>&& bytes) {
+			if (bytes.size() > MAX_PAYLOAD_SIZE) {
+				throw std::runtime_error("Frame size too big.");
+			}
+			std::shared_ptr<Storage> s = std::make_shared<Storage>();
+			s->header_size = static_cast<unsigned char>(Framing::encode_header(bytes.size(), s->header));
+			s->trailer_size = static_cast<unsigned char>(Framing::encode_trailer(s->trailer));
+			s->payload = std::move(bytes);
+			storage = std::move(s);
+		}
+
+		/*
+		Bytes that are already encoded, e.g. several coalesced frames, sent as is without header or trailer.
+		*/
+		static BasicSharedFrame encoded(std::vector<unsigned char>&& bytes) {
+			std::shared_ptr<Storage> s = std::make_shared<Storage>();
+			s->payload = std::move(bytes);
+			BasicSharedFrame frame;
+			frame.storage = std::move(s);
+			return frame;
+		}
+
+		const unsigned char* header() const {
+			return storage->header;
+		}
+
+		size_t header_size() const {
+			return storage->header_size;
+		}
+
+		const unsigned char* payload() const {
+			return storage->payload.data();
+		}
+
+		size_t payload_size() const {
+			return storage->payload.size();
+		}
+
+		const unsigned char* trailer() const {
+			return storage->trailer;
+		}
+
+		size_t trailer_size() const {
+			return storage->trailer_size;
+		}
+
+		// header, payload and trailer, the number of bytes a socket puts on the wire
+		size_t size() const {
+			return storage->header_size + storage->payload.size() + storage->trailer_size;
+		}
+
+		// number of frames (queued on sockets or held by the application) sharing the storage
+		long use_count() const {
+			return storage.use_count();
+		}
+
+		explicit operator bool() const {
+			return storage != nullptr;
+		}
+	private:
+		struct Storage {
+			unsigned char header[Framing::MAX_HEADER_SIZE > 0 ? Framing::MAX_HEADER_SIZE : 1];
+			unsigned char trailer[Framing::MAX_TRAILER_SIZE > 0 ? Framing::MAX_TRAILER_SIZE : 1];
+			unsigned char header_size = 0;
+			unsigned char trailer_size = 0;
+			std::vector<unsigned char> payload;
+		};
+
+		std::shared_ptr<const Storage> storage;
+	};
+
+	using SharedFrame = BasicSharedFrame<DefaultFraming>;
+} // namespace cpp_socket::transportlayer
+
+#endif // SHARED_FRAME_H
@@ -0,0 +1,345 @@
+#ifndef TCP_CONNECTION_POOL_H
+#define TCP_CONNECTION_POOL_H
+
+#include <transportlayer/TcpSocket.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <memory>
+
+namespace cpp_socket::transportlayer {
+	/*
+	Keeps a number of connected, non-blocking sockets warm per endpoint so that
+	the request path only has to lease an already established connection.
+
+	- Connects are started in the background and completed with readiness + SO_ERROR.
+	- Idle connections are health checked periodically and replaced if the peer closed them.
+	- Not thread safe, use one pool per event loop thread and call maintain() from it.
+	*/
+	template <typename Socket>
+	class BasicTcpConnectionPool {
+		using clock = std::chrono::steady_clock;
+
+		struct PooledConnection {
+			std::unique_ptr<Socket> socket;
+			clock::time_point since;
+			short revents = 0;
+		};
+
+		struct EndpointPool {
+			address_family_t ip_protocol;
+			std::string ip;
+			int port;
+			std::vector<PooledConnection> pending;
+			std::vector<PooledConnection> idle;
+			// handed out and not returned yet, they count toward the connections kept
+			size_t leased = 0;
+			clock::time_point retry_at;
+			unsigned int failures = 0;
+		};
+	public:
+		/*
+		Leased connection, returned to the pool when destroyed.
+		Call discard() if the connection is broken or left mid-frame, so it is closed instead.
+		A lease refers to its pool and must not outlive it, destroy or release() every
+		lease before the pool. Debug builds assert this in the pool's destructor.
+		*/
+		class Lease {
+		public:
+			Lease() = default;
+
+			Lease(const Lease&) = delete;
+			Lease& operator=(const Lease&) = delete;
+
+			Lease(Lease&& other) noexcept {
+				*this = std::move(other);
+			}
+
+			Lease& operator=(Lease&& other) noexcept {
+				if (this != &other) {
+					give_back();
+					pool = other.pool;
+					endpoint = other.endpoint;
+					socket = std::move(other.socket);
+					other.pool = nullptr;
+				}
+				return *this;
+			}
+
+			~Lease() {
+				give_back();
+			}
+
+			Socket* get() {
+				return socket.get();
+			}
+
+			Socket* operator->() {
+				return socket.get();
+			}
+
+			explicit operator bool() const {
+				return socket != nullptr;
+			}
+
+			// closes the connection, the pool opens a replacement
+			void discard() {
+				socket.reset();
+				detach();
+			}
+
+			/*
+			Takes the connection out of the pool for good.
+			*/
+			std::unique_ptr<Socket> release() {
+				detach();
+				return std::move(socket);
+			}
+		private:
+			friend class BasicTcpConnectionPool;
+
+			Lease(BasicTcpConnectionPool* pool, size_t endpoint, std::unique_ptr<Socket>&& socket)
+				:pool(pool), endpoint(endpoint), socket(std::move(socket)) {
+
+			}
+
+			void give_back() {
+				if (pool != nullptr && socket != nullptr) {
+					pool->give_back(endpoint, std::move(socket));
+				}
+				detach();
+				socket.reset();
+			}
+
+			void detach() {
+				if (pool != nullptr) {
+					pool->endpoints[endpoint].leased--;
+					pool = nullptr;
+				}
+			}
+
+			BasicTcpConnectionPool* pool = nullptr;
+			size_t endpoint = 0;
+			std::unique_ptr<Socket> socket;
+		};
+
+		/*
+		- connections_per_endpoint: connections kept per endpoint, leased ones included. A leased
+		  connection is only replaced once it is discarded or released.
+		- connect_timeout: pending connects older than this are dropped and retried.
+		- health_check_interval: how often idle connections are checked for a closed peer.
+		*/
+		BasicTcpConnectionPool(size_t connections_per_endpoint,
+			std::chrono::milliseconds connect_timeout = std::chrono::milliseconds(3000),
+			std::chrono::milliseconds health_check_interval = std::chrono::milliseconds(1000))
+			:connections_per_endpoint(connections_per_endpoint),
+			connect_timeout(connect_timeout),
+			health_check_interval(health_check_interval) {
+
+		}
+
+		BasicTcpConnectionPool(const BasicTcpConnectionPool&) = delete;
+		BasicTcpConnectionPool& operator=(const BasicTcpConnectionPool&) = delete;
+
+		~BasicTcpConnectionPool() {
+			#ifndef NDEBUG
+			for (EndpointPool& endpoint: endpoints) {
+				assert(endpoint.leased == 0 && "a Lease outlives its TcpConnectionPool");
+			}
+			#endif
+		}
+
+		/*
+		Registers an endpoint and starts warming connections to it.
+		- Returns the endpoint id to be passed to acquire().
+		*/
+		size_t add_endpoint(address_family_t ip_protocol, std::string ip, int port) {
+			EndpointPool endpoint;
+			endpoint.ip_protocol = ip_protocol;
+			endpoint.ip = std::move(ip);
+			endpoint.port = port;
+			endpoints.push_back(std::move(endpoint));
+			refill(endpoints.back(), clock::now());
+			return endpoints.size() - 1;
+		}
+
+		/*
+		- Returns an established connection, or an empty lease if none is ready yet.
+		*/
+		Lease acquire(size_t endpoint) {
+			std::vector<PooledConnection>& idle = endpoints.at(endpoint).idle;
+			if (idle.empty()) {
+				return Lease();
+			}
+			std::unique_ptr<Socket> socket = std::move(idle.back().socket);
+			idle.pop_back();
+			endpoints[endpoint].leased++;
+			return Lease(this, endpoint, std::move(socket));
+		}
+
+		/*
+		Completes pending connects, health checks idle connections and opens replacements.
+		Waits at most timeout_ms for readiness, pass 0 to only process what is ready.
+		- Returns -1 if polling failed.
+		- Returns the number of connections established during this call otherwise.
+		*/
+		int maintain(int timeout_ms) {
+			clock::time_point now = clock::now();
+			for (EndpointPool& endpoint: endpoints) {
+				refill(endpoint, now);
+			}
+
+			pollfds.clear();
+			for (EndpointPool& endpoint: endpoints) {
+				for (PooledConnection& connection: endpoint.pending) {
+					add_pollfd(connection.socket->get_socket(), POLLOUT);
+				}
+				for (PooledConnection& connection: endpoint.idle) {
+					if (now - connection.since >= health_check_interval) {
+						add_pollfd(connection.socket->get_socket(), POLLIN | RDHUP_EVENT);
+					}
+				}
+			}
+
+			if (!pollfds.empty()) {
+				int r = POLL(pollfds.data(), pollfds.size(), timeout_ms);
+				if (r == SOCKET_ERROR) {
+					return -1;
+				}
+				now = clock::now();
+			}
+
+			size_t i = 0;
+			for (EndpointPool& endpoint: endpoints) {
+				for (PooledConnection& connection: endpoint.pending) {
+					connection.revents = pollfds[i++].revents;
+				}
+				for (PooledConnection& connection: endpoint.idle) {
+					if (i < pollfds.size() && pollfds[i].fd == connection.socket->get_socket()) {
+						connection.revents = pollfds[i++].revents;
+						connection.since = now;
+						if (connection.revents == 0) {
+							continue;
+						}
+						if (!is_alive(*connection.socket, connection.revents)) {
+							connection.socket.reset();
+						}
+					}
+				}
+			}
+
+			int established = 0;
+			for (EndpointPool& endpoint: endpoints) {
+				established += complete_connects(endpoint, now);
+				std::erase_if(endpoint.idle, [](PooledConnection& c) { return c.socket == nullptr; });
+				refill(endpoint, now);
+			}
+			return established;
+		}
+
+		size_t idle_count(size_t endpoint) {
+			return endpoints.at(endpoint).idle.size();
+		}
+
+		size_t pending_count(size_t endpoint) {
+			return endpoints.at(endpoint).pending.size();
+		}
+	private:
+		#ifdef POLLRDHUP
+			static constexpr short RDHUP_EVENT = POLLRDHUP;
+		#else
+			static constexpr short RDHUP_EVENT = 0;
+		#endif
+
+		void add_pollfd(SOCKET_TYPE socket, short events) {
+			POLLFD_TYPE pfd;
+			pfd.fd = socket;
+			pfd.events = events;
+			pfd.revents = 0;
+			pollfds.push_back(pfd);
+		}
+
+		/*
+		An idle connection must never be readable, readable means either the peer
+		closed it or it sent data nobody is going to read.
+		*/
+		static bool is_alive(Socket& socket, short revents) {
+			if (revents & (POLLERR | POLLHUP | POLLNVAL | RDHUP_EVENT)) {
+				return false;
+			}
+			if (revents & POLLIN) {
+				char c;
+				int r = socket.receive_wrapper(&c, 1, MSG_PEEK);
+				return r < 0 && cpp_socket::base::get_syscall_error() == WOULDBLOCK_ERROR;
+			}
+			return true;
+		}
+
+		int complete_connects(EndpointPool& endpoint, clock::time_point now) {
+			int established = 0;
+			for (PooledConnection& connection: endpoint.pending) {
+				int r = 0;
+				if (connection.revents != 0) {
+					r = connection.socket->finish_connect();
+				}
+				if (r == 0 && now - connection.since >= connect_timeout) {
+					r = -1;
+				}
+
+				if (r == 1) {
+					connection.since = now;
+					endpoint.idle.push_back(std::move(connection));
+					endpoint.failures = 0;
+					established++;
+				}
+				else if (r == -1) {
+					connection.socket.reset();
+					mark_failure(endpoint, now);
+				}
+			}
+			std::erase_if(endpoint.pending, [](PooledConnection& c) { return c.socket == nullptr; });
+			return established;
+		}
+
+		void refill(EndpointPool& endpoint, clock::time_point now) {
+			while (endpoint.pending.size() + endpoint.idle.size() + endpoint.leased < connections_per_endpoint && now >= endpoint.retry_at) {
+				PooledConnection connection;
+				try {
+					connection.socket = std::make_unique<Socket>(endpoint.ip_protocol, endpoint.ip, endpoint.port, false);
+				} catch (std::runtime_error&) {
+					mark_failure(endpoint, now);
+					return;
+				}
+				connection.since = now;
+				endpoint.pending.push_back(std::move(connection));
+			}
+		}
+
+		// exponential backoff so a dead backend is not hammered with connects
+		void mark_failure(EndpointPool& endpoint, clock::time_point now) {
+			unsigned int shift = std::min(endpoint.failures, 6u);
+			endpoint.failures++;
+			endpoint.retry_at = now + std::chrono::milliseconds(50) * (1 << shift);
+		}
+
+		// leased connections are not replaced, so a returned one always has its place
+		void give_back(size_t endpoint, std::unique_ptr<Socket>&& socket) {
+			EndpointPool& pool = endpoints.at(endpoint);
+			PooledConnection connection;
+			connection.socket = std::move(socket);
+			// force a health check on the next maintain()
+			connection.since = clock::time_point();
+			pool.idle.insert(pool.idle.begin(), std::move(connection));
+		}
+
+		size_t connections_per_endpoint;
+		std::chrono::milliseconds connect_timeout;
+		std::chrono::milliseconds health_check_interval;
+		std::vector<EndpointPool> endpoints;
+		std::vector<POLLFD_TYPE> pollfds;
+	};
+
+	using TcpConnectionPool = BasicTcpConnectionPool<TcpSocket>;
+} // namespace cpp_socket::transportlayer
+
+#endif // TCP_CONNECTION_POOL_H
@@ -0,0 +1,282 @@
+#ifndef TCP_INFO_H
+#define TCP_INFO_H
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+#include <base/SocketWrapper.h>
+#include <base/LatencyHistogram.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using cpp_socket::base::LatencyHistogram;
+
+namespace cpp_socket::transportlayer {
+	/*
+	struct tcp_info of linux/tcp.h up to tcpi_bytes_retrans, glibc only declares the
+	fields up to tcpi_total_retrans and linux/tcp.h clashes with netinet/tcp.h.
+	Older kernels fill less, the rest stays 0.
+	*/
+	struct tcp_info_t {
+		tcp_info base;
+		uint64_t pacing_rate;
+		uint64_t max_pacing_rate;
+		uint64_t bytes_acked;
+		uint64_t bytes_received;
+		uint32_t segs_out;
+		uint32_t segs_in;
+		uint32_t notsent_bytes;
+		uint32_t min_rtt;
+		uint32_t data_segs_in;
+		uint32_t data_segs_out;
+		uint64_t delivery_rate;
+		uint64_t busy_time;
+		uint64_t rwnd_limited;
+		uint64_t sndbuf_limited;
+		uint32_t delivered;
+		uint32_t delivered_ce;
+		uint64_t bytes_sent;
+		uint64_t bytes_retrans;
+	};
+
+	/*
+	Transport state of one TCP connection at one point in time, from TCP_INFO and
+	the SIOCOUTQ/SIOCOUTQNSD/SIOCINQ ioctls.
+	*/
+	struct TcpInfoSample {
+		// TCP_ESTABLISHED, ... and the congestion avoidance state (TCP_CA_Open, TCP_CA_Loss, ...)
+		uint8_t state = 0;
+		uint8_t ca_state = 0;
+		// smoothed RTT, its variance and the lowest RTT seen, microseconds
+		uint32_t rtt_us = 0;
+		uint32_t rtt_var_us = 0;
+		uint32_t min_rtt_us = 0;
+		// congestion window and slow start threshold in segments of mss bytes
+		uint32_t cwnd = 0;
+		uint32_t ssthresh = 0;
+		uint32_t mss = 0;
+		// segments in flight, of them presumed lost and being retransmitted
+		uint32_t unacked = 0;
+		uint32_t lost = 0;
+		uint32_t retransmitting = 0;
+		uint32_t total_retransmits = 0;
+		// bytes per second
+		uint64_t delivery_rate = 0;
+		uint64_t pacing_rate = 0;
+		uint64_t bytes_sent = 0;
+		uint64_t bytes_retransmitted = 0;
+		uint64_t bytes_received = 0;
+		// microseconds the sender was busy, and of that limited by the peer's window or the send buffer
+		uint64_t busy_us = 0;
+		uint64_t receive_window_limited_us = 0;
+		uint64_t send_buffer_limited_us = 0;
+		// bytes in the socket buffers: written but not acked, not even sent yet, received but not read
+		uint32_t send_queue = 0;
+		uint32_t not_sent = 0;
+		uint32_t receive_queue = 0;
+	};
+
+	/*
+	Reads TCP_INFO and the queue sizes of a connected TCP socket, a getsockopt and three
+	ioctls that do not touch the data path.
+	- Returns -1 on syscall error.
+	*/
+	inline int sample_tcp_info(SOCKET_TYPE socket, TcpInfoSample& sample) {
+		tcp_info_t info{};
+		socklen_t size = sizeof(info);
+		if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &size) == -1) {
+			return -1;
+		}
+		int send_queue = 0;
+		int not_sent = 0;
+		int receive_queue = 0;
+		if (ioctl(socket, SIOCOUTQ, &send_queue) == -1 || ioctl(socket, SIOCOUTQNSD, &not_sent) == -1
+			|| ioctl(socket, SIOCINQ, &receive_queue) == -1) {
+			return -1;
+		}
+
+		sample.state = info.base.tcpi_state;
+		sample.ca_state = info.base.tcpi_ca_state;
+		sample.rtt_us = info.base.tcpi_rtt;
+		sample.rtt_var_us = info.base.tcpi_rttvar;
+		sample.min_rtt_us = info.min_rtt;
+		sample.cwnd = info.base.tcpi_snd_cwnd;
+		sample.ssthresh = info.base.tcpi_snd_ssthresh;
+		sample.mss = info.base.tcpi_snd_mss;
+		sample.unacked = info.base.tcpi_unacked;
+		sample.lost = info.base.tcpi_lost;
+		sample.retransmitting = info.base.tcpi_retrans;
+		sample.total_retransmits = info.base.tcpi_total_retrans;
+		sample.delivery_rate = info.delivery_rate;
+		sample.pacing_rate = info.pacing_rate;
+		sample.bytes_sent = info.bytes_sent;
+		sample.bytes_retransmitted = info.bytes_retrans;
+		sample.bytes_received = info.bytes_received;
+		sample.busy_us = info.busy_time;
+		sample.receive_window_limited_us = info.rwnd_limited;
+		sample.send_buffer_limited_us = info.sndbuf_limited;
+		sample.send_queue = static_cast<uint32_t>(send_queue);
+		sample.not_sent = static_cast<uint32_t>(not_sent);
+		sample.receive_queue = static_cast<uint32_t>(receive_queue);
+		return 0;
+	}
+
+	// what makes a connection one of the worst in TransportMetrics
+	enum transport_rank_t {
+		RANK_BY_RTT,
+		RANK_BY_RETRANSMITS,
+		RANK_BY_SEND_QUEUE,
+		// heap memory held by the connection, see TcpSocket::memory_usage
+		RANK_BY_MEMORY
+	};
+
+	/*
+	Aggregate of TcpInfoSamples over many connections: a histogram per metric and the
+	connections ranking worst, with the sample that put them there. Recording is
+	allocation free. Not thread safe, keep one per thread and merge() them for reporting.
+	- Id: identifies a connection in the worst list, e.g. a TcpServer::ConnectionHandle.
+	*/
+	template <typename Id>
+	class TransportMetrics {
+	public:
+		struct Entry {
+			Id id;
+			TcpInfoSample sample;
+			// retransmits since the previous sample of the connection
+			uint32_t retransmits = 0;
+			size_t memory = 0;
+			uint64_t score = 0;
+		};
+
+		// - top: number of worst connections kept, 0 keeps none
+		explicit TransportMetrics(size_t top = 0, transport_rank_t rank = RANK_BY_RTT)
+			:top(top), rank(rank) {
+			entries.reserve(top);
+		}
+
+		/*
+		- retransmits: retransmits since the previous sample of the connection, the
+		  cumulative counter of the sample would rank old connections worst.
+		- memory: heap memory the connection holds in user space.
+		*/
+		void record(const Id& id, const TcpInfoSample& sample, uint32_t retransmits, size_t memory = 0) {
+			rtt_histogram.record(sample.rtt_us);
+			cwnd_histogram.record(sample.cwnd);
+			retransmit_histogram.record(retransmits);
+			send_queue_histogram.record(sample.send_queue);
+			receive_queue_histogram.record(sample.receive_queue);
+			memory_histogram.record(memory);
+			if (top > 0) {
+				insert({id, sample, retransmits, memory, score_of(sample, retransmits, memory)});
+			}
+		}
+
+		void merge(const TransportMetrics& other) {
+			rtt_histogram.merge(other.rtt_histogram);
+			cwnd_histogram.merge(other.cwnd_histogram);
+			retransmit_histogram.merge(other.retransmit_histogram);
+			send_queue_histogram.merge(other.send_queue_histogram);
+			receive_queue_histogram.merge(other.receive_queue_histogram);
+			memory_histogram.merge(other.memory_histogram);
+			if (top > 0) {
+				for (const Entry& entry: other.entries) {
+					insert(entry);
+				}
+			}
+		}
+
+		// keeps the top size and rank
+		void reset() {
+			rtt_histogram.reset();
+			cwnd_histogram.reset();
+			retransmit_histogram.reset();
+			send_queue_histogram.reset();
+			receive_queue_histogram.reset();
+			memory_histogram.reset();
+			entries.clear();
+		}
+
+		// number of samples recorded
+		uint64_t samples() const {
+			return rtt_histogram.count();
+		}
+
+		// microseconds
+		const LatencyHistogram& rtt() const {
+			return rtt_histogram;
+		}
+
+		// segments
+		const LatencyHistogram& cwnd() const {
+			return cwnd_histogram;
+		}
+
+		// per connection since its previous sample
+		const LatencyHistogram& retransmits() const {
+			return retransmit_histogram;
+		}
+
+		// bytes written but not acked
+		const LatencyHistogram& send_queue() const {
+			return send_queue_histogram;
+		}
+
+		// bytes received but not read by the application
+		const LatencyHistogram& receive_queue() const {
+			return receive_queue_histogram;
+		}
+
+		// bytes of heap memory per connection
+		const LatencyHistogram& memory() const {
+			return memory_histogram;
+		}
+
+		// worst first
+		const std::vector<Entry>& worst() const {
+			return entries;
+		}
+	private:
+		uint64_t score_of(const TcpInfoSample& sample, uint32_t retransmits, size_t memory) {
+			switch (rank) {
+				case RANK_BY_RETRANSMITS:
+					return retransmits;
+				case RANK_BY_SEND_QUEUE:
+					return sample.send_queue;
+				case RANK_BY_MEMORY:
+					return memory;
+				default:
+					return sample.rtt_us;
+			}
+		}
+
+		// keeps entries sorted worst first, within the capacity reserved up front
+		void insert(const Entry& entry) {
+			if (entries.size() == top && (top == 0 || entry.score <= entries.back().score)) {
+				return;
+			}
+			size_t position = std::upper_bound(entries.begin(), entries.end(), entry.score,
+				[](uint64_t score, const Entry& e) { return score > e.score; }) - entries.begin();
+			if (entries.size() == top) {
+				entries.pop_back();
+			}
+			entries.insert(entries.begin() + position, entry);
+		}
+
+		size_t top;
+		transport_rank_t rank;
+		LatencyHistogram rtt_histogram;
+		LatencyHistogram cwnd_histogram;
+		LatencyHistogram retransmit_histogram;
+		LatencyHistogram send_queue_histogram;
+		LatencyHistogram receive_queue_histogram;
+		LatencyHistogram memory_histogram;
+		std::vector<Entry> entries;
+	};
+} // namespace cpp_socket::transportlayer
+
+#endif // TCP_INFO_H
@@ -0,0 +1,291 @@
+#ifndef TCP_RELAY_H
+#define TCP_RELAY_H
+
+#include <base/EventLoop.h>
+#include <base/Pipe.h>
+#include <transportlayer/TcpSocket.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using cpp_socket::base::EventLoop;
+using cpp_socket::base::Pipe;
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::transportlayer {
+	/*
+	L4 relay: pumps the bytes of socket pairs in both directions with splice through
+	a pipe per direction, so payload never reaches userspace. Driven by the readiness
+	events of an EventLoop, a direction stops reading while its destination does not
+	take more, so a pair holds at most two pipes of data. A FIN is passed on as
+	shutdown(SHUT_WR) once everything before it is written, the pair is closed when
+	both directions finished or either socket fails.
+	- Socket: a BasicTcpSocket, the framing is not used.
+	*/
+	template <typename Socket = TcpSocket>
+	class BasicTcpRelay {
+	public:
+		class Pair {
+		public:
+			Pair(const Pair&) = delete;
+			Pair& operator=(const Pair&) = delete;
+
+			Socket& first() {
+				return *sockets[0];
+			}
+
+			Socket& second() {
+				return *sockets[1];
+			}
+
+			// bytes written from first to second
+			uint64_t forwarded_bytes() {
+				return directions[0].bytes;
+			}
+
+			// bytes written from second to first
+			uint64_t returned_bytes() {
+				return directions[1].bytes;
+			}
+		private:
+			friend class BasicTcpRelay;
+
+			// one per socket, events of a socket concern the direction it reads and the one it writes
+			struct Endpoint: public EventLoop::Handler {
+				void on_events(uint32_t events) override {
+					pair->on_events(side, events);
+				}
+
+				Pair* pair;
+				int side;
+			};
+
+			struct Direction {
+				Pipe pipe;
+				// bytes in the pipe, not yet written to the destination
+				size_t buffered = 0;
+				// the destination did not take everything, wait for EPOLLOUT
+				bool blocked = false;
+				// the source sent its FIN
+				bool eof = false;
+				bool shutdown = false;
+				uint64_t bytes = 0;
+			};
+
+			Pair(BasicTcpRelay* relay, std::unique_ptr<Socket> first, std::unique_ptr<Socket> second)
+				:relay(relay) {
+				sockets[0] = std::move(first);
+				sockets[1] = std::move(second);
+				for (int side = 0; side < 2; side++) {
+					endpoints[side].pair = this;
+					endpoints[side].side = side;
+					if (relay->pipe_size > 0) {
+						directions[side].pipe.set_capacity(relay->pipe_size);
+					}
+					capacity[side] = directions[side].pipe.get_capacity();
+				}
+			}
+
+			// a direction is named after the side it reads from
+			void on_events(int side, uint32_t events) {
+				if (closing) {
+					return;
+				}
+				if (events & EPOLLERR) {
+					close();
+					return;
+				}
+				if (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP)) {
+					pump(side);
+				}
+				if (!closing && (events & EPOLLOUT)) {
+					pump(1 - side);
+				}
+				if (!closing) {
+					update_interest();
+				}
+			}
+
+			// a busy direction yields to the other pairs after this many splices per event
+			static constexpr int MAX_SPLICES_PER_EVENT = 16;
+			static constexpr uint32_t REMOVED = ~0u;
+
+			void pump(int from) {
+				Direction& d = directions[from];
+				SOCKET_TYPE source = sockets[from]->get_socket();
+				SOCKET_TYPE destination = sockets[1 - from]->get_socket();
+				for (int i = 0; i < MAX_SPLICES_PER_EVENT; i++) {
+					if (d.buffered > 0) {
+						ssize_t n = splice(d.pipe.read_fd(), nullptr, destination, nullptr, d.buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+						if (n < 0) {
+							if (errno == WOULDBLOCK_ERROR) {
+								d.blocked = true;
+								return;
+							}
+							close();
+							return;
+						}
+						d.buffered -= n;
+						d.bytes += n;
+						relay->total_bytes.fetch_add(n, std::memory_order_relaxed);
+						continue;
+					}
+					d.blocked = false;
+
+					if (d.eof) {
+						if (!d.shutdown) {
+							d.shutdown = true;
+							::shutdown(destination, SHUT_WR);
+							if (directions[1 - from].shutdown) {
+								close();
+							}
+						}
+						return;
+					}
+
+					ssize_t n = splice(source, nullptr, d.pipe.write_fd(), nullptr, capacity[from], SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+					if (n == 0) {
+						d.eof = true;
+					}
+					else if (n < 0) {
+						if (errno != WOULDBLOCK_ERROR) {
+							close();
+						}
+						return;
+					}
+					else {
+						d.buffered = n;
+					}
+				}
+			}
+
+			/*
+			A socket is read while its direction has not seen a FIN and is not waiting
+			for the destination, and written while the other direction waits for it.
+			A socket done in both directions reports EPOLLHUP for good, it is removed.
+			*/
+			void update_interest() {
+				for (int side = 0; side < 2; side++) {
+					if (interest[side] == REMOVED) {
+						continue;
+					}
+					if (directions[side].eof && directions[1 - side].shutdown) {
+						interest[side] = REMOVED;
+						relay->loop.remove(sockets[side]->get_socket());
+						continue;
+					}
+					uint32_t events = 0;
+					if (!directions[side].eof && !directions[side].blocked) {
+						events |= EPOLLIN | EPOLLRDHUP;
+					}
+					if (directions[1 - side].blocked) {
+						events |= EPOLLOUT;
+					}
+					if (events != interest[side]) {
+						interest[side] = events;
+						relay->loop.modify(sockets[side]->get_socket(), events, &endpoints[side]);
+					}
+				}
+			}
+
+			// the pair is destroyed after the current loop iteration, the other socket may still have events pending
+			void close() {
+				if (closing) {
+					return;
+				}
+				closing = true;
+				for (int side = 0; side < 2; side++) {
+					if (interest[side] != REMOVED) {
+						relay->loop.remove(sockets[side]->get_socket());
+					}
+				}
+				relay->loop.post([relay = relay, this] {
+					if (relay->close_callback) {
+						relay->close_callback(*this);
+					}
+					relay->destroy(this);
+				});
+			}
+
+			BasicTcpRelay* relay;
+			std::unique_ptr<Socket> sockets[2];
+			Endpoint endpoints[2];
+			Direction directions[2];
+			size_t capacity[2];
+			uint32_t interest[2] = {EPOLLIN | EPOLLRDHUP, EPOLLIN | EPOLLRDHUP};
+			bool closing = false;
+			size_t slot = 0;
+		};
+
+		using close_callback_t = std::function<void(Pair&)>;
+
+		/*
+		- pipe_size: capacity of each of the two pipes of a pair, 0 keeps the kernel default (64 KB).
+		  It bounds the bytes a pair holds and moves per splice.
+		*/
+		explicit BasicTcpRelay(EventLoop& loop, int pipe_size = 0)
+			:loop(loop), pipe_size(pipe_size) {
+
+		}
+
+		BasicTcpRelay(const BasicTcpRelay&) = delete;
+		BasicTcpRelay& operator=(const BasicTcpRelay&) = delete;
+
+		/*
+		Relays between two connected, non-blocking sockets until both sides closed or either
+		failed. Call from the loop thread, or before the loop runs.
+		- Returns nullptr if the sockets could not be registered, they are closed then.
+		*/
+		Pair* relay(std::unique_ptr<Socket> first, std::unique_ptr<Socket> second) {
+			std::unique_ptr<Pair> pair(new Pair(this, std::move(first), std::move(second)));
+			Pair* p = pair.get();
+			p->slot = pairs.size();
+			pairs.push_back(std::move(pair));
+			for (int side = 0; side < 2; side++) {
+				if (loop.add(p->sockets[side]->get_socket(), p->interest[side], &p->endpoints[side]) == SOCKET_ERROR) {
+					if (side == 1) {
+						loop.remove(p->sockets[0]->get_socket());
+					}
+					destroy(p);
+					return nullptr;
+				}
+			}
+			return p;
+		}
+
+		// called on the loop thread once a pair is closed, before its sockets are
+		void on_close(close_callback_t callback) {
+			close_callback = std::move(callback);
+		}
+
+		size_t pair_count() {
+			return pairs.size();
+		}
+
+		// bytes relayed by all pairs in both directions, safe to call from any thread
+		uint64_t relayed_bytes() {
+			return total_bytes.load(std::memory_order_relaxed);
+		}
+	private:
+		void destroy(Pair* pair) {
+			size_t slot = pair->slot;
+			std::swap(pairs[slot], pairs.back());
+			pairs[slot]->slot = slot;
+			pairs.pop_back();
+		}
+
+		EventLoop& loop;
+		int pipe_size;
+		close_callback_t close_callback;
+		std::vector<std::unique_ptr<Pair>> pairs;
+		std::atomic<uint64_t> total_bytes = 0;
+	};
+
+	using TcpRelay = BasicTcpRelay<>;
+} // namespace cpp_socket::transportlayer
+
+#endif // TCP_RELAY_H
@@ -0,0 +1,1158 @@
+#ifndef TCP_SERVER_H
+#define TCP_SERVER_H
+
+#include <transportlayer/TcpSocket.h>
+#include <base/EventLoop.h>
+#include <base/EventFd.h>
+#include <base/TimerFd.h>
+#include <base/LockFreeQueue.h>
+#include <base/Slab.h>
+#include <base/WorkStealingPool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <variant>
+
+using cpp_socket::base::EventLoop;
+using cpp_socket::base::TimerWheel;
+using cpp_socket::base::EventFd;
+using cpp_socket::base::TimerFd;
+using cpp_socket::base::SpscQueue;
+using cpp_socket::base::Slab;
+using cpp_socket::base::SlabHandle;
+using cpp_socket::base::WorkStealingPool;
+using cpp_socket::base::SpinStats;
+using cpp_socket::base::pin_thread;
+
+namespace cpp_socket::transportlayer {
+	/*
+	Readiness driven TCP server. A listener thread accepts connections as soon as they
+	arrive and hands them round robin to a pool of worker threads through lock-free
+	single producer queues, every worker runs
+	its own EventLoop and owns its connections, so callbacks of a connection always
+	run on the same thread and idle connections cost nothing.
+
+	With an executor set, on_message runs on a WorkStealingPool instead: every
+	connection gets a strand so its messages are still handled one at a time and
+	in order, while I/O stays on the worker threads.
+
+	Timeouts and heartbeats run on the timer wheel of the worker's event loop, so
+	arming them on every read or write is O(1) and no thread scans the connections.
+
+	Memory is bounded with high/low watermarks: a connection stops being read while
+	its own output, the output of all connections or the messages waiting for its
+	handlers are above the high watermark, and is read again once below the low one.
+
+	With transport sampling on, every worker reads TCP_INFO of its connections spread
+	over the sampling interval and publishes histograms and the worst connections of
+	each full sweep, see set_transport_sampling.
+
+	Connections live in a Slab per worker and the listener hands over bare descriptors,
+	so accepting and closing connections does not allocate them one by one. Other
+	threads refer to a connection through its ConnectionHandle, which resolves to
+	nothing once the connection is gone even if its slot was reused.
+
+	- State: per connection user state, default constructed before on_connect.
+	- Socket: a BasicTcpSocket, selects the framing.
+	*/
+	template <typename State = std::monostate, typename Socket = TcpSocket>
+	class BasicTcpServer {
+		struct Worker;
+	public:
+		// a connection of a worker, valid as long as the connection is not destroyed
+		struct ConnectionHandle {
+			size_t worker = 0;
+			SlabHandle connection;
+
+			bool operator==(const ConnectionHandle& other) const {
+				return worker == other.worker && connection == other.connection;
+			}
+		};
+
+		class Connection: public EventLoop::Handler {
+		public:
+			State state;
+
+			Socket& socket() {
+				return m_socket;
+			}
+
+			// for referring to the connection from other threads or after callbacks returned
+			ConnectionHandle handle() {
+				return {worker->index, self};
+			}
+
+			/*
+			Queues the frame and writes as much as the socket takes right away,
+			the rest is written when the socket becomes writable.
+			Called from a message handler on the executor, the frame is handed
+			to the worker thread and sent from there.
+			- Returns -2 if the frame is too big or contains the delimiter.
+			- Returns 1 if successfull.
+			*/
+			int send(std::vector<unsigned char> bytes) {
+				if (m_socket.exceeds_max_frame_size(bytes.size()) || m_socket.contains_delimiter(bytes.data(), bytes.size())) {
+					return -2;
+				}
+				return send(typename Socket::shared_frame_type(std::move(bytes)));
+			}
+
+			int send(const typename Socket::shared_frame_type& frame) {
+				if (!worker->loop.is_loop_thread()) {
+					worker->server->on_connection(handle(), [frame](Connection& connection) {
+						connection.send(frame);
+					});
+					return 1;
+				}
+				int r = m_socket.enqueue_frame(frame);
+				if (r == 1) {
+					flush();
+				}
+				return r;
+			}
+
+			/*
+			Closes the connection, no more messages are read from it. on_close is
+			called and the connection destroyed once no handler of it is running
+			anymore, at the earliest after the current event loop iteration.
+			*/
+			void close() {
+				if (!worker->loop.is_loop_thread()) {
+					worker->server->on_connection(handle(), [](Connection& connection) {
+						connection.close();
+					});
+					return;
+				}
+				if (closing) {
+					return;
+				}
+				closing = true;
+				worker->loop.remove(m_socket.get_socket());
+				if (pause_reasons != 0) {
+					resume(pause_reasons);
+				}
+				account_send(0);
+				TimerWheel& timers = worker->loop.timers();
+				for (TimerWheel::Timer* timer: {&idle_timer, &read_timer, &write_timer, &heartbeat_timer, &shrink_timer}) {
+					timers.cancel(*timer);
+				}
+				release();
+			}
+
+			bool is_closing() {
+				return closing;
+			}
+
+			/*
+			True while the output of the connection or of the whole server is above its high
+			watermark, writers should hold back until on_backpressure reports false.
+			Safe to call from any thread.
+			*/
+			bool is_throttled() {
+				return throttled;
+			}
+
+			// total time the connection was not read because of backpressure
+			std::chrono::nanoseconds throttled_time() {
+				std::chrono::nanoseconds total = throttled_total;
+				if (pause_reasons != 0) {
+					total += std::chrono::steady_clock::now() - throttled_since;
+				}
+				return total;
+			}
+
+			size_t worker_index() {
+				return worker->index;
+			}
+
+			// the last transport sample taken by set_transport_sampling, all 0 before the first
+			const TcpInfoSample& transport_sample() {
+				return transport;
+			}
+
+			SocketMemory memory_usage() {
+				return m_socket.memory_usage();
+			}
+		private:
+			friend class BasicTcpServer;
+			friend class Slab<Connection>;
+
+			// a busy connection yields to the others after this many frames per readiness event
+			static constexpr int MAX_FRAMES_PER_EVENT = 64;
+
+			// why reading is paused
+			static constexpr unsigned SEND_BACKLOG = 1;
+			static constexpr unsigned RECEIVE_BACKLOG = 2;
+			static constexpr unsigned GLOBAL_BUDGET = 4;
+
+			// the socket is constructed in place from a descriptor accepted by the listener
+			Connection(Worker* worker, SOCKET_TYPE socket, Address&& address)
+				:worker(worker), m_socket(worker->server->m_listener.accepted(socket, std::move(address))),
+				idle_timer([this] { close(); }),
+				read_timer([this] { close(); }),
+				write_timer([this] { close(); }),
+				heartbeat_timer([this] { this->worker->server->heartbeat_callback(*this); }),
+				shrink_timer([this] { m_socket.shrink_buffers(); }) {
+
+			}
+
+			// arms the timers configured on the server, called once the connection is registered
+			void start_timers() {
+				BasicTcpServer* server = worker->server;
+				TimerWheel& timers = worker->loop.timers();
+				if (server->idle_timeout.count() > 0) {
+					timers.schedule(idle_timer, server->idle_timeout);
+				}
+				if (server->heartbeat_interval.count() > 0 && server->heartbeat_callback) {
+					timers.schedule_periodic(heartbeat_timer, server->heartbeat_interval);
+				}
+				if (server->shrink_after.count() > 0) {
+					timers.schedule(shrink_timer, server->shrink_after);
+				}
+			}
+
+			void on_events(uint32_t events) override {
+				if (closing) {
+					return;
+				}
+				if (worker->server->idle_timeout.count() > 0) {
+					worker->loop.timers().extend(idle_timer, worker->server->idle_timeout);
+				}
+				if (worker->server->shrink_after.count() > 0) {
+					// fires once per idle period, the next event arms it again
+					worker->loop.timers().extend(shrink_timer, worker->server->shrink_after);
+				}
+				if (pause_reasons == 0 && worker->server->global_throttled) {
+					// the global budget is enforced lazily, a connection pauses on its next event
+					pause(GLOBAL_BUDGET);
+				}
+				if (pause_reasons != 0 && (events & (EPOLLHUP | EPOLLERR))) {
+					// not reading, and the peer is gone
+					close();
+					return;
+				}
+				if (pause_reasons == 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP))) {
+					receive();
+					update_read_timer();
+				}
+				if (!closing && (events & EPOLLOUT)) {
+					flush();
+				}
+			}
+
+			void receive() {
+				for (int i = 0; i < MAX_FRAMES_PER_EVENT && !closing && pause_reasons == 0; i++) {
+					int r = m_socket.receive_data();
+					if (r == 1) {
+						std::vector<unsigned char> data = m_socket.dump_received_data();
+						if (strand != nullptr) {
+							dispatch(std::move(data));
+						}
+						else if (worker->server->message_callback) {
+							worker->server->message_callback(*this, std::move(data));
+						}
+					}
+					else if (r == -1 && cpp_socket::base::get_syscall_error() == WOULDBLOCK_ERROR) {
+						return;
+					}
+					else {
+						// closed, failed or malformed, the stream cannot be recovered
+						close();
+					}
+				}
+			}
+
+			// every handler in flight holds a reference, so the connection outlives it
+			void dispatch(std::vector<unsigned char>&& data) {
+				const Watermarks& limits = worker->server->receive_watermarks;
+				size_t size = data.size();
+				size_t inflight = inflight_receive.fetch_add(size) + size;
+				if (limits.high > 0 && inflight >= limits.high) {
+					pause(RECEIVE_BACKLOG);
+				}
+
+				refs.fetch_add(1);
+				strand->post([this, size, data = std::move(data)]() mutable {
+					worker->server->message_callback(*this, std::move(data));
+					size_t before = inflight_receive.fetch_sub(size);
+					size_t low = worker->server->receive_watermarks.low;
+					if (before > low && before - size <= low) {
+						// only read while paused, so it cannot rise above low again before this runs
+						worker->loop.post([this] {
+							if (!closing && (pause_reasons & RECEIVE_BACKLOG) && inflight_receive <= worker->server->receive_watermarks.low) {
+								resume(RECEIVE_BACKLOG);
+							}
+						});
+					}
+					release();
+				});
+			}
+
+			void pause(unsigned reason) {
+				if (pause_reasons & reason) {
+					return;
+				}
+				if (pause_reasons == 0) {
+					throttled_since = std::chrono::steady_clock::now();
+					worker->server->pause_count++;
+				}
+				pause_reasons |= reason;
+				update_interest();
+			}
+
+			void resume(unsigned reasons) {
+				if ((pause_reasons & reasons) == 0) {
+					return;
+				}
+				pause_reasons &= ~reasons;
+				if (pause_reasons == 0) {
+					std::chrono::nanoseconds paused = std::chrono::steady_clock::now() - throttled_since;
+					throttled_total += paused;
+					worker->server->throttled_ns += paused.count();
+				}
+				update_interest();
+				if (pause_reasons == 0 && !closing) {
+					// data that arrived while paused is not signaled again
+					receive();
+					update_read_timer();
+				}
+			}
+
+			void update_interest() {
+				bool was_throttled = throttled;
+				throttled = (pause_reasons & (SEND_BACKLOG | GLOBAL_BUDGET)) != 0;
+				if (closing) {
+					return;
+				}
+				worker->loop.modify(m_socket.get_socket(), events(), this);
+				if (was_throttled != throttled && worker->server->backpressure_callback) {
+					worker->server->backpressure_callback(*this, throttled);
+				}
+			}
+
+			// checks the pending output against the connection and global watermarks
+			void update_send_backpressure() {
+				size_t pending = m_socket.pending_send_bytes();
+				account_send(pending);
+				const Watermarks& limits = worker->server->send_watermarks;
+				if (limits.high == 0) {
+					return;
+				}
+				if (pending >= limits.high) {
+					pause(SEND_BACKLOG);
+				}
+				else if (pending <= limits.low) {
+					resume(SEND_BACKLOG);
+				}
+			}
+
+			void account_send(size_t pending) {
+				if (pending != accounted_send) {
+					worker->server->add_global_pending(static_cast<int64_t>(pending) - static_cast<int64_t>(accounted_send));
+					accounted_send = pending;
+				}
+			}
+
+			// the last reference, held by the worker until close(), schedules the destroy
+			void release() {
+				if (refs.fetch_sub(1) == 1) {
+					Worker* w = worker;
+					w->loop.post([w, this] {
+						if (w->server->close_callback) {
+							w->server->close_callback(*this);
+						}
+						w->destroy(this);
+					});
+				}
+			}
+
+			// a frame that started arriving has to complete within the read timeout
+			void update_read_timer() {
+				if (closing || worker->server->read_timeout.count() <= 0) {
+					return;
+				}
+				if (!m_socket.receive_in_progress()) {
+					worker->loop.timers().cancel(read_timer);
+				}
+				else if (!read_timer.is_armed()) {
+					worker->loop.timers().schedule(read_timer, worker->server->read_timeout);
+				}
+			}
+
+			void flush() {
+				int r = m_socket.send_data();
+				bool blocked = r == -1 && cpp_socket::base::get_syscall_error() == WOULDBLOCK_ERROR;
+				if (r == 0 || (r == -1 && !blocked)) {
+					close();
+					return;
+				}
+				if (blocked != want_write) {
+					want_write = blocked;
+					worker->loop.modify(m_socket.get_socket(), events(), this);
+					update_write_timer();
+				}
+				if (m_socket.coalesced_bytes() > 0 && !flush_scheduled) {
+					// coalesced frames are written by their flush deadline even if nothing else is sent
+					flush_scheduled = true;
+					worker->schedule_flush(this, m_socket.flush_deadline());
+				}
+				update_send_backpressure();
+			}
+
+			// queued output has to be written completely within the write timeout
+			void update_write_timer() {
+				if (worker->server->write_timeout.count() <= 0) {
+					return;
+				}
+				if (want_write) {
+					worker->loop.timers().schedule(write_timer, worker->server->write_timeout);
+				}
+				else {
+					worker->loop.timers().cancel(write_timer);
+				}
+			}
+
+			void sample_transport(TransportMetrics<ConnectionHandle>& metrics) {
+				TcpInfoSample sample;
+				if (closing || m_socket.get_tcp_info(sample) == -1) {
+					return;
+				}
+				uint32_t retransmits = sample.total_retransmits - transport.total_retransmits;
+				transport = sample;
+				metrics.record(handle(), sample, retransmits, m_socket.memory_usage().total());
+			}
+
+			uint32_t events() {
+				uint32_t read = pause_reasons == 0 ? static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) : 0u;
+				return read | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+			}
+
+			Worker* worker;
+			Socket m_socket;
+			std::shared_ptr<WorkStealingPool::Strand> strand;
+			std::atomic<int> refs = 1;
+			// in the slab of the worker
+			SlabHandle self;
+			// index in the connections of the worker
+			size_t slot = 0;
+			bool want_write = false;
+			// the flush deadline is queued on the worker
+			bool flush_scheduled = false;
+			std::atomic<bool> closing = false;
+
+			unsigned pause_reasons = 0;
+			std::atomic<bool> throttled = false;
+			std::chrono::steady_clock::time_point throttled_since;
+			std::chrono::nanoseconds throttled_total{0};
+			// pending output counted in the global budget
+			size_t accounted_send = 0;
+			// bytes of the messages dispatched to the executor and not handled yet
+			std::atomic<size_t> inflight_receive = 0;
+			TcpInfoSample transport;
+
+			TimerWheel::Timer idle_timer;
+			TimerWheel::Timer read_timer;
+			TimerWheel::Timer write_timer;
+			TimerWheel::Timer heartbeat_timer;
+			TimerWheel::Timer shrink_timer;
+		};
+
+		using connect_callback_t = std::function<void(Connection&)>;
+		using message_callback_t = std::function<void(Connection&, std::vector<unsigned char>&&)>;
+		using close_callback_t = std::function<void(Connection&)>;
+		using heartbeat_callback_t = std::function<void(Connection&)>;
+		using backpressure_callback_t = std::function<void(Connection&, bool)>;
+
+		// 0 disables, low has to be below high
+		struct Watermarks {
+			size_t high = 0;
+			size_t low = 0;
+		};
+
+		struct BackpressureStats {
+			// times a connection stopped being read
+			uint64_t pauses = 0;
+			// summed over all connections, for pauses that ended
+			std::chrono::nanoseconds throttled_time{0};
+			// times the global budget was exceeded and the time it stayed exceeded
+			uint64_t global_pauses = 0;
+			std::chrono::nanoseconds global_throttled_time{0};
+			size_t global_pending_bytes = 0;
+		};
+
+		/*
+		- workers: number of worker threads, each runs its own event loop.
+		- tuning: applied to the listener and inherited by the accepted connections.
+		*/
+		BasicTcpServer(address_family_t ip_protocol, std::string ip, int port, size_t workers, const TcpTuning& tuning = TcpTuning())
+			:m_listener(ip_protocol, ip, port, false, tuning), spare_fd(open_spare()) {
+			if (workers == 0) {
+				throw std::runtime_error("At least one worker is required.");
+			}
+			for (size_t i = 0; i < workers; i++) {
+				this->workers.push_back(std::make_unique<Worker>(this, i));
+			}
+		}
+
+		BasicTcpServer(const BasicTcpServer&) = delete;
+		BasicTcpServer& operator=(const BasicTcpServer&) = delete;
+
+		~BasicTcpServer() {
+			stop();
+			join();
+			if (spare_fd != -1) {
+				::close(spare_fd);
+			}
+		}
+
+		/*
+		Runs on_message on the pool instead of the worker thread, set it before start().
+		Handlers may only use send(), close(), is_closing() and state of the connection.
+		- pool: must outlive the server.
+		*/
+		void set_executor(WorkStealingPool* pool) {
+			executor = pool;
+		}
+
+		// callbacks run on the worker thread owning the connection, set them before start()
+		void on_connect(connect_callback_t callback) {
+			connect_callback = std::move(callback);
+		}
+
+		void on_message(message_callback_t callback) {
+			message_callback = std::move(callback);
+		}
+
+		void on_close(close_callback_t callback) {
+			close_callback = std::move(callback);
+		}
+
+		/*
+		Called every interval for every connection, e.g. to send a ping the peer has to answer
+		within the idle timeout.
+		*/
+		void on_heartbeat(std::chrono::milliseconds interval, heartbeat_callback_t callback) {
+			heartbeat_interval = interval;
+			heartbeat_callback = std::move(callback);
+		}
+
+		/*
+		Pending output per connection, see TcpSocket::pending_send_bytes. Reading stops at high
+		and resumes at low, set them before start().
+		*/
+		void set_send_watermarks(size_t high, size_t low) {
+			send_watermarks = {high, std::min(low, high)};
+		}
+
+		/*
+		Bytes of the messages of a connection waiting for or running in executor handlers,
+		reading stops at high and resumes at low. Without executor, handlers run inline and
+		reading waits for them anyway.
+		*/
+		void set_receive_watermarks(size_t high, size_t low) {
+			receive_watermarks = {high, std::min(low, high)};
+		}
+
+		/*
+		Pending output of all connections together, while above high no connection is read.
+		*/
+		void set_global_send_budget(size_t high, size_t low) {
+			global_budget = {high, std::min(low, high)};
+		}
+
+		/*
+		Called on the worker thread when Connection::is_throttled changes, writers producing
+		for the connection should pause on true and resume on false.
+		*/
+		void on_backpressure(backpressure_callback_t callback) {
+			backpressure_callback = std::move(callback);
+		}
+
+		BackpressureStats backpressure_stats() {
+			BackpressureStats stats;
+			stats.pauses = pause_count;
+			stats.throttled_time = std::chrono::nanoseconds(throttled_ns.load());
+			stats.global_pauses = global_pause_count;
+			stats.global_throttled_time = std::chrono::nanoseconds(global_throttled_ns.load());
+			if (global_throttled) {
+				stats.global_throttled_time += std::chrono::steady_clock::now().time_since_epoch() - std::chrono::nanoseconds(global_since_ns.load());
+			}
+			stats.global_pending_bytes = global_pending;
+			return stats;
+		}
+
+		/*
+		Connections are closed when a timeout expires, set them before start(), 0 disables.
+		- idle: nothing was received or became writable for this long.
+		- read: a frame that started arriving was not completed in time (slow clients).
+		- write: queued output was not written completely in time (peers not reading).
+		*/
+		void set_timeouts(std::chrono::milliseconds idle, std::chrono::milliseconds read, std::chrono::milliseconds write) {
+			idle_timeout = idle;
+			read_timeout = read;
+			write_timeout = write;
+		}
+
+		/*
+		Low latency mode for the workers, set it before start(): each worker loop spins
+		for spin_ns after its last event before sleeping, see EventLoop::run_spinning.
+		- first_cpu: worker i is pinned to first_cpu + i, -1 leaves them unpinned.
+		- busy_poll_usecs: epoll busy polling of the worker loops (Linux 6.9), 0 disables.
+		*/
+		void set_spinning(int64_t spin_ns, int first_cpu = -1, uint32_t busy_poll_usecs = 0) {
+			spin_time = spin_ns;
+			spin_first_cpu = first_cpu;
+			busy_poll = busy_poll_usecs;
+		}
+
+		/*
+		Connections that had no I/O event for this long give back the buffer memory
+		their pending data does not need, see TcpSocket::shrink_buffers. Set it before
+		start(), 0 disables.
+		*/
+		void set_buffer_shrinking(std::chrono::milliseconds idle) {
+			shrink_after = idle;
+		}
+
+		/*
+		Samples TCP_INFO and the socket queues of every connection about once per interval
+		on the worker threads, a slice of the connections every few milliseconds so no
+		loop stalls on a sweep. Each finished sweep replaces the metrics transport_metrics()
+		reports. Set it before start(), 0 disables.
+		- top: worst connections reported, ranked by rank.
+		*/
+		void set_transport_sampling(std::chrono::milliseconds interval, size_t top = 10, transport_rank_t rank = RANK_BY_RTT) {
+			sample_interval = interval;
+			for (std::unique_ptr<Worker>& worker: workers) {
+				worker->sampling = TransportMetrics<ConnectionHandle>(top, rank);
+				worker->published = TransportMetrics<ConnectionHandle>(top, rank);
+			}
+			sample_top = top;
+			sample_rank = rank;
+		}
+
+		/*
+		Metrics of the last full sweep of every worker, merged. Safe to call from any
+		thread, the workers only wait for it while publishing a finished sweep.
+		*/
+		TransportMetrics<ConnectionHandle> transport_metrics() {
+			TransportMetrics<ConnectionHandle> metrics(sample_top, sample_rank);
+			for (std::unique_ptr<Worker>& worker: workers) {
+				std::lock_guard<std::mutex> lock(worker->published_mutex);
+				metrics.merge(worker->published);
+			}
+			return metrics;
+		}
+
+		// spin hits and sleeps of all workers
+		SpinStats spin_stats() {
+			SpinStats total;
+			for (std::unique_ptr<Worker>& worker: workers) {
+				SpinStats stats = worker->loop.spin_stats();
+				total.spin_hits += stats.spin_hits;
+				total.sleeps += stats.sleeps;
+			}
+			return total;
+		}
+
+		Socket& listener() {
+			return m_listener;
+		}
+
+		/*
+		Allocates room for this many connections per worker up front, set it before start().
+		Past it the slab of a worker grows by a chunk at a time.
+		*/
+		void reserve_connections(size_t per_worker) {
+			for (std::unique_ptr<Worker>& worker: workers) {
+				worker->slab.reserve(per_worker);
+				worker->connections.reserve(per_worker);
+			}
+		}
+
+		/*
+		Sends on a connection from any thread, the frame is queued on the worker owning it.
+		Dropped if the connection is closed by then.
+		- Returns -2 if the frame is too big or contains the delimiter.
+		- Returns 1 if successfull.
+		*/
+		int send(ConnectionHandle handle, std::vector<unsigned char> bytes) {
+			if (m_listener.exceeds_max_frame_size(bytes.size()) || m_listener.contains_delimiter(bytes.data(), bytes.size())) {
+				return -2;
+			}
+			typename Socket::shared_frame_type frame(std::move(bytes));
+			on_connection(handle, [frame](Connection& connection) {
+				connection.send(frame);
+			});
+			return 1;
+		}
+
+		// closes a connection from any thread, nothing happens if it is already gone
+		void close(ConnectionHandle handle) {
+			on_connection(handle, [](Connection& connection) {
+				connection.close();
+			});
+		}
+
+		size_t connection_count() {
+			return connections;
+		}
+
+		// connections closed right after accepting because the process ran out of descriptors
+		uint64_t rejected_count() {
+			return rejected;
+		}
+
+		/*
+		Starts the listener and worker threads.
+		*/
+		void start() {
+			if (acceptor.add(m_listener.get_socket(), EPOLLIN, &accept_handler) == SOCKET_ERROR) {
+				throw std::runtime_error("Failed to register listener.");
+			}
+			for (std::unique_ptr<Worker>& worker: workers) {
+				Worker* w = worker.get();
+				if (sample_interval.count() > 0) {
+					w->loop.timers().schedule_periodic(w->sample_timer, std::min(sample_interval, SAMPLE_TICK));
+				}
+				if (spin_time > 0) {
+					if (busy_poll > 0) {
+						w->loop.set_busy_poll(busy_poll);
+					}
+					int cpu = spin_first_cpu >= 0 ? spin_first_cpu + static_cast<int>(w->index) : -1;
+					w->thread = std::thread([w, cpu, spin = spin_time] {
+						// a worker that cannot be pinned still serves its connections
+						if (cpu >= 0) {
+							pin_thread(cpu);
+						}
+						w->loop.run_spinning(spin);
+					});
+					continue;
+				}
+				w->thread = std::thread([w] { w->loop.run(); });
+			}
+			acceptor_thread = std::thread([this] { acceptor.run(); });
+		}
+
+		// safe to call from any thread, including callbacks
+		void stop() {
+			acceptor.stop();
+			for (std::unique_ptr<Worker>& worker: workers) {
+				worker->loop.stop();
+			}
+		}
+
+		/*
+		Blocks until the server is stopped, then closes all connections.
+		*/
+		void join() {
+			if (acceptor_thread.joinable()) {
+				acceptor_thread.join();
+			}
+			for (std::unique_ptr<Worker>& worker: workers) {
+				if (worker->thread.joinable()) {
+					worker->thread.join();
+				}
+			}
+			for (std::unique_ptr<Worker>& worker: workers) {
+				// adopt connections handed over after the worker stopped, then close everything
+				worker->adopt_accepted();
+				worker->loop.run_once(0);
+				while (!worker->connections.empty()) {
+					worker->connections.back()->close();
+					// blocks until the destroy is posted, once the handlers in flight are done,
+					// post() wakes the loop although it is stopped
+					worker->loop.run_once(-1);
+				}
+			}
+		}
+	private:
+		// a descriptor accepted by the listener, wrapped by the worker that serves it
+		struct AcceptedSocket {
+			SOCKET_TYPE socket = INVALID_SOCKET;
+			Address address;
+		};
+
+		struct Worker: public EventLoop::Handler {
+			Worker(BasicTcpServer* server, size_t index)
+				:server(server), index(index) {
+				if (loop.add(accept_event.get_fd(), EPOLLIN, this) == SOCKET_ERROR) {
+					throw std::runtime_error("Failed to register accept queue.");
+				}
+				if (loop.add(flush_timer.get_fd(), EPOLLIN, &flush_handler) == SOCKET_ERROR) {
+					throw std::runtime_error("Failed to register flush timer.");
+				}
+			}
+
+			// the acceptor signaled new connections in the queue
+			void on_events(uint32_t) override {
+				accept_event.drain();
+				adopt_accepted();
+			}
+
+			void adopt_accepted() {
+				AcceptedSocket socket;
+				while (accepted.try_pop(socket)) {
+					adopt(std::move(socket));
+				}
+			}
+
+			void adopt(AcceptedSocket&& socket) {
+				SlabHandle handle;
+				Connection* c = slab.create(handle, this, socket.socket, std::move(socket.address));
+				c->self = handle;
+				if (server->executor != nullptr) {
+					c->strand = server->executor->make_strand();
+				}
+				c->slot = connections.size();
+				connections.push_back(c);
+				server->connections++;
+
+				if (loop.add(c->m_socket.get_socket(), c->events(), c) == SOCKET_ERROR) {
+					destroy(c);
+					return;
+				}
+				c->start_timers();
+				if (server->connect_callback) {
+					server->connect_callback(*c);
+				}
+			}
+
+			void resume_global() {
+				if (server->global_throttled) {
+					return;
+				}
+				// resuming reads and may close, which only swaps in connections already visited
+				for (size_t i = 0; i < connections.size(); i++) {
+					if (connections[i]->pause_reasons & Connection::GLOBAL_BUDGET) {
+						connections[i]->resume(Connection::GLOBAL_BUDGET);
+					}
+				}
+			}
+
+			/*
+			Samples the share of the connections that completes a sweep per sample interval,
+			publishing the sweep once the cursor reaches the end.
+			*/
+			void sample_transport() {
+				auto tick = std::min(server->sample_interval, SAMPLE_TICK);
+				size_t budget = (connections.size() * tick.count() + server->sample_interval.count() - 1) / server->sample_interval.count();
+				for (; budget > 0 && sample_cursor < connections.size(); budget--, sample_cursor++) {
+					connections[sample_cursor]->sample_transport(sampling);
+				}
+				if (sample_cursor < connections.size()) {
+					return;
+				}
+				sample_cursor = 0;
+				if (sampling.samples() == 0 && published.samples() == 0) {
+					return;
+				}
+				// connections swapped in behind the cursor wait for the next sweep
+				std::lock_guard<std::mutex> lock(published_mutex);
+				std::swap(published, sampling);
+				sampling.reset();
+			}
+
+			/*
+			Coalescing deadlines are often below a millisecond, finer than the timer wheel and
+			the epoll_wait timeout, so they are kept in a heap with a timerfd armed at the
+			earliest. Entries of closed connections are dropped when they come up.
+			*/
+			void schedule_flush(Connection* connection, std::chrono::steady_clock::time_point deadline) {
+				flush_deadlines.push({deadline, connection->self});
+				if (deadline < flush_armed) {
+					flush_armed = deadline;
+					flush_timer.arm(deadline);
+				}
+			}
+
+			void flush_due() {
+				flush_timer.drain();
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				while (!flush_deadlines.empty() && flush_deadlines.top().deadline <= now) {
+					SlabHandle handle = flush_deadlines.top().connection;
+					flush_deadlines.pop();
+					if (Connection* connection = find(handle)) {
+						// a buffer started after the deadline schedules its own
+						connection->flush_scheduled = false;
+						connection->flush();
+					}
+				}
+				flush_armed = flush_deadlines.empty() ? std::chrono::steady_clock::time_point::max() : flush_deadlines.top().deadline;
+				if (!flush_deadlines.empty()) {
+					flush_timer.arm(flush_armed);
+				}
+			}
+
+			// nullptr if the connection is gone or closing
+			Connection* find(SlabHandle handle) {
+				Connection* connection = slab.get(handle);
+				return connection != nullptr && !connection->closing ? connection : nullptr;
+			}
+
+			void destroy(Connection* connection) {
+				size_t slot = connection->slot;
+				std::swap(connections[slot], connections.back());
+				connections[slot]->slot = slot;
+				connections.pop_back();
+				server->connections--;
+				slab.destroy(connection->self);
+			}
+
+			BasicTcpServer* server;
+			size_t index;
+			EventLoop loop;
+			std::thread thread;
+			Slab<Connection> slab;
+			std::vector<Connection*> connections;
+
+			struct FlushDeadline {
+				std::chrono::steady_clock::time_point deadline;
+				SlabHandle connection;
+
+				bool operator>(const FlushDeadline& other) const {
+					return deadline > other.deadline;
+				}
+			};
+
+			struct FlushHandler: public EventLoop::Handler {
+				explicit FlushHandler(Worker* worker)
+					:worker(worker) {
+
+				}
+
+				void on_events(uint32_t) override {
+					worker->flush_due();
+				}
+
+				Worker* worker;
+			};
+
+			std::priority_queue<FlushDeadline, std::vector<FlushDeadline>, std::greater<FlushDeadline>> flush_deadlines;
+			// the deadline flush_timer is armed for, max() if none
+			std::chrono::steady_clock::time_point flush_armed = std::chrono::steady_clock::time_point::max();
+			TimerFd flush_timer;
+			FlushHandler flush_handler{this};
+
+			TimerWheel::Timer sample_timer{[this] { sample_transport(); }};
+			size_t sample_cursor = 0;
+			TransportMetrics<ConnectionHandle> sampling;
+			// the last full sweep, read by transport_metrics()
+			TransportMetrics<ConnectionHandle> published;
+			std::mutex published_mutex;
+
+			// written by the acceptor thread only
+			SpscQueue<AcceptedSocket> accepted{ACCEPT_QUEUE_SIZE};
+			EventFd accept_event;
+			bool accept_notify = false;
+		};
+
+		struct AcceptHandler: public EventLoop::Handler {
+			explicit AcceptHandler(BasicTcpServer* server)
+				:server(server) {
+
+			}
+
+			void on_events(uint32_t) override {
+				server->accept_pending();
+			}
+
+			BasicTcpServer* server;
+		};
+
+		/*
+		Drains the listen queue, nothing is left waiting for the next readiness event.
+		Every worker is signaled once per batch, a full queue falls back to post().
+		*/
+		void accept_pending() {
+			AcceptedSocket socket;
+			while (true) {
+				socket.socket = m_listener.accept_descriptor(socket.address);
+				if (socket.socket == INVALID_SOCKET) {
+					if (accept_failed(cpp_socket::base::get_syscall_error())) {
+						continue;
+					}
+					break;
+				}
+				Worker* worker = workers[next_worker].get();
+				next_worker = (next_worker + 1) % workers.size();
+				if (worker->accepted.try_push(std::move(socket))) {
+					worker->accept_notify = true;
+				}
+				else {
+					worker->loop.post([worker, socket]() mutable { worker->adopt(std::move(socket)); });
+				}
+			}
+			for (std::unique_ptr<Worker>& worker: workers) {
+				if (worker->accept_notify) {
+					worker->accept_notify = false;
+					worker->accept_event.notify();
+				}
+			}
+		}
+
+		/*
+		The listener is level triggered, a connection left in the listen queue because
+		accept failed makes it readable again right away. Out of descriptors, the spare
+		one is given up to accept the connection and close it. Other lasting failures
+		(ENOBUFS, ENOMEM, ...) take the listener out of the loop for ACCEPT_RETRY.
+		- Returns true if accepting can go on.
+		*/
+		bool accept_failed(int error) {
+			if (error == WOULDBLOCK_ERROR) {
+				return false;
+			}
+			else if (error == EINTR || error == ECONNABORTED || error == EPROTO) {
+				// only this connection is lost
+				return true;
+			}
+			else if (error == EMFILE || error == ENFILE) {
+				// accept fails this way even with nothing pending
+				int r = reject_pending();
+				if (r >= 0) {
+					return r == 1;
+				}
+			}
+			acceptor.remove(m_listener.get_socket());
+			acceptor.timers().schedule(accept_retry_timer, ACCEPT_RETRY);
+			return false;
+		}
+
+		/*
+		- Returns -1 if the spare descriptor is gone or accepting failed even with it.
+		- Returns 0 if no connection is pending.
+		- Returns 1 if a connection was rejected.
+		*/
+		int reject_pending() {
+			if (spare_fd == -1) {
+				return -1;
+			}
+			::close(spare_fd);
+			SOCKET_TYPE socket = accept(m_listener.get_socket(), nullptr, nullptr);
+			int r = 1;
+			if (socket != INVALID_SOCKET) {
+				::close(socket);
+				rejected++;
+			}
+			else {
+				r = cpp_socket::base::get_syscall_error() == WOULDBLOCK_ERROR ? 0 : -1;
+			}
+			// another thread may take the descriptor meanwhile, then the next exhaustion pauses instead
+			spare_fd = open_spare();
+			return r;
+		}
+
+		void resume_accepting() {
+			if (spare_fd == -1) {
+				spare_fd = open_spare();
+			}
+			// pending connections make the listener readable right away
+			acceptor.add(m_listener.get_socket(), EPOLLIN, &accept_handler);
+		}
+
+		static int open_spare() {
+			return open("/dev/null", O_RDONLY | O_CLOEXEC);
+		}
+
+		static constexpr size_t ACCEPT_QUEUE_SIZE = 256;
+		static constexpr std::chrono::milliseconds ACCEPT_RETRY{100};
+		// transport sampling spreads a sweep over ticks of this length
+		static constexpr std::chrono::milliseconds SAMPLE_TICK{10};
+
+		// runs f on the worker thread owning the connection, if it is still open then
+		template <typename F>
+		void on_connection(ConnectionHandle handle, F&& f) {
+			if (handle.worker >= workers.size()) {
+				return;
+			}
+			Worker* w = workers[handle.worker].get();
+			if (w->loop.is_loop_thread()) {
+				if (Connection* connection = w->find(handle.connection)) {
+					f(*connection);
+				}
+				return;
+			}
+			w->loop.post([w, handle, f = std::forward<F>(f)]() mutable {
+				if (Connection* connection = w->find(handle.connection)) {
+					f(*connection);
+				}
+			});
+		}
+
+		/*
+		Crossing the high watermark only sets the flag, connections pause on their next event.
+		Dropping below low resumes the paused connections on every worker.
+		*/
+		void add_global_pending(int64_t delta) {
+			size_t total = global_pending.fetch_add(delta) + delta;
+			if (global_budget.high == 0) {
+				return;
+			}
+			if (total >= global_budget.high && !global_throttled) {
+				if (!global_throttled.exchange(true)) {
+					global_pause_count++;
+					global_since_ns = std::chrono::steady_clock::now().time_since_epoch().count();
+				}
+			}
+			else if (total <= global_budget.low && global_throttled) {
+				if (global_throttled.exchange(false)) {
+					global_throttled_ns += std::chrono::steady_clock::now().time_since_epoch().count() - global_since_ns;
+					for (std::unique_ptr<Worker>& worker: workers) {
+						Worker* w = worker.get();
+						w->loop.post([w] { w->resume_global(); });
+					}
+				}
+			}
+		}
+
+		Socket m_listener;
+		EventLoop acceptor;
+		AcceptHandler accept_handler{this};
+		TimerWheel::Timer accept_retry_timer{[this] { resume_accepting(); }};
+		// kept open to be given up for rejecting connections when out of descriptors
+		int spare_fd;
+		std::atomic<uint64_t> rejected = 0;
+		std::thread acceptor_thread;
+		std::vector<std::unique_ptr<Worker>> workers;
+		size_t next_worker = 0;
+		std::atomic<size_t> connections = 0;
+		WorkStealingPool* executor = nullptr;
+
+		connect_callback_t connect_callback;
+		message_callback_t message_callback;
+		close_callback_t close_callback;
+		heartbeat_callback_t heartbeat_callback;
+		backpressure_callback_t backpressure_callback;
+
+		Watermarks send_watermarks;
+		Watermarks receive_watermarks;
+		Watermarks global_budget;
+		std::atomic<size_t> global_pending = 0;
+		std::atomic<bool> global_throttled = false;
+		std::atomic<int64_t> global_since_ns = 0;
+		std::atomic<uint64_t> global_pause_count = 0;
+		std::atomic<int64_t> global_throttled_ns = 0;
+		std::atomic<uint64_t> pause_count = 0;
+		std::atomic<int64_t> throttled_ns = 0;
+
+		std::chrono::milliseconds idle_timeout{0};
+		std::chrono::milliseconds read_timeout{0};
+		std::chrono::milliseconds write_timeout{0};
+		std::chrono::milliseconds heartbeat_interval{0};
+		std::chrono::milliseconds shrink_after{0};
+		std::chrono::milliseconds sample_interval{0};
+		size_t sample_top = 0;
+		transport_rank_t sample_rank = RANK_BY_RTT;
+		int64_t spin_time = 0;
+		int spin_first_cpu = -1;
+		uint32_t busy_poll = 0;
+	};
+
+	using TcpServer = BasicTcpServer<>;
+} // namespace cpp_socket::transportlayer
+
+#endif // TCP_SERVER_H
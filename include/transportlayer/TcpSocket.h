@@ -2,105 +2,525 @@
 #define TCP_SOCKET_H
 
 #include <base/SocketWrapper.h>
+#include <base/RingQueue.h>
+#include <transportlayer/Framing.h>
+#include <transportlayer/SharedFrame.h>
+#include <transportlayer/TcpTuning.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <optional>
+#ifdef __unix__
+	#include <base/Pipe.h>
+	#include <transportlayer/TcpInfo.h>
+	#include <sys/sendfile.h>
+	#include <memory>
+#endif
 
 using cpp_socket::base::SocketWrapper;
+using cpp_socket::base::RingQueue;
 using cpp_socket::base::Address;
 using cpp_socket::base::address_family_t;
+#ifdef __unix__
+using cpp_socket::base::PacketTimestamps;
+using cpp_socket::base::ErrorQueueEntry;
+using cpp_socket::base::Pipe;
+#endif
 
 namespace cpp_socket::transportlayer {
-	class TcpSocket: public SocketWrapper {
+	/*
+	Heap memory a socket holds for its connection, see BasicTcpSocket::memory_usage.
+	*/
+	struct SocketMemory {
+		// the part of a frame received so far
+		size_t receive_buffer = 0;
+		// frames queued for sending, a shared frame counts on every socket holding it
+		size_t send_queue = 0;
+		size_t coalesce_buffer = 0;
+		// rings of the internal queues
+		size_t queues = 0;
+
+		size_t total() const {
+			return receive_buffer + send_queue + coalesce_buffer + queues;
+		}
+	};
+
+	/*
+	Framed TCP socket, the wire format of the frames is selected at compile time with
+	one of the policies in Framing.h. TcpSocket uses a 4 byte big endian size header.
+	*/
+	template <typename Framing>
+	class BasicTcpSocket: public SocketWrapper {
 	public:
-		TcpSocket(address_family_t ip_protocol, std::string ip, int port, bool blocking)
-			:SocketWrapper(ip_protocol, SOCK_STREAM, 0, createAddress(ip_protocol, ip, port), blocking) {
-			
+		using framing_type = Framing;
+		using shared_frame_type = BasicSharedFrame<Framing>;
+
+		BasicTcpSocket(address_family_t ip_protocol, std::string ip, int port, bool blocking, tuning_profile_t profile = DEFAULT_TUNING)
+			:BasicTcpSocket(ip_protocol, ip, port, blocking, TcpTuning::from_profile(profile)) {
+
 		}
 
-		TcpSocket(SOCKET_TYPE m_socket, Address&& address, bool blocking)
-			:SocketWrapper(m_socket, std::move(address), blocking) {
+		/*
+		The tuning is applied before connecting or listening, accepted sockets inherit it.
+		*/
+		BasicTcpSocket(address_family_t ip_protocol, std::string ip, int port, bool blocking, const TcpTuning& tuning)
+			:SocketWrapper(ip_protocol, SOCK_STREAM, 0, createAddress(ip_protocol, ip, port), blocking,
+				[&tuning](SOCKET_TYPE s) { tuning.apply(s); }), tuning(tuning) {
+			
+		}
 
+		BasicTcpSocket(SOCKET_TYPE m_socket, Address&& address, bool blocking, const TcpTuning& tuning = TcpTuning())
+			:SocketWrapper(m_socket, std::move(address), blocking), tuning(tuning) {
+			tuning.apply(m_socket);
 		}
 
-		TcpSocket* accept_connection() {
-			SOCKET_TYPE clientSocket;
-			sockaddr client_sockaddr;
-			socklen_t client_sockaddr_size = sizeof(client_sockaddr);
+		BasicTcpSocket accept_connection() {
+			std::optional<BasicTcpSocket> client = try_accept_connection();
+
+			if (!client) {
+				throw std::runtime_error("Error accepting client.");
+			}
 
-			clientSocket = accept(m_socket, reinterpret_cast<struct sockaddr *>(&client_sockaddr), &client_sockaddr_size);
+			return std::move(*client);
+		}
+
+		/*
+		Same as accept_connection without throwing, for draining the listen queue of a
+		non-blocking socket.
+		- Returns nothing if there is syscall error, WOULDBLOCK_ERROR if nothing is pending.
+		*/
+		std::optional<BasicTcpSocket> try_accept_connection() {
+			Address clientAddress;
+			SOCKET_TYPE clientSocket = accept_socket(clientAddress);
 
 			if (clientSocket == INVALID_SOCKET) {
-				throw std::runtime_error("Error accepting client.");
+				return std::nullopt;
 			}
 
-			Address clientAddress(client_sockaddr, address.get_address_family());
+			return accepted(clientSocket, std::move(clientAddress));
+		}
 
-			return new TcpSocket(clientSocket, std::move(clientAddress), blocking);
+		/*
+		accept() without wrapping the new descriptor, for owners that construct the socket
+		elsewhere, e.g. in place on the thread that serves it. Pass the result to accepted().
+		- Returns INVALID_SOCKET on syscall error, WOULDBLOCK_ERROR if nothing is pending.
+		*/
+		SOCKET_TYPE accept_descriptor(Address& client_address) {
+			return accept_socket(client_address);
 		}
 
 		/*
-		- Returns -2 if size is too big. Max size limit is 2^32-1 bytes.
+		Wraps a descriptor accepted by this listener, the socket inherits its blocking
+		mode, tuning and frame size limit.
+		*/
+		BasicTcpSocket accepted(SOCKET_TYPE client_socket, Address&& client_address) {
+			BasicTcpSocket client(client_socket, std::move(client_address), blocking, tuning);
+			client.max_frame_size = max_frame_size;
+			return client;
+		}
+
+		/*
+		Frames bigger than this are refused by set_send_data/enqueue_frame and make
+		receive_data return -2, so a peer cannot make the socket allocate arbitrary memory.
+		A raw stream has no frames, there it only caps the bytes returned by one receive
+		and sends are not limited. The default depends on the framing, see Framing.h.
+		Accepted sockets inherit it.
+		*/
+		void set_max_frame_size(uint64_t size) {
+			max_frame_size = std::min(size, Framing::MAX_FRAME_SIZE);
+		}
+
+		uint64_t get_max_frame_size() {
+			return max_frame_size;
+		}
+
+		// true if a frame of size bytes would be refused for sending
+		bool exceeds_max_frame_size(uint64_t size) {
+			return Framing::KIND != RAW_STREAM && size > max_frame_size;
+		}
+
+		// true if the payload would be refused for sending because it contains the delimiter,
+		// which would end the frame early on the receiving side
+		bool contains_delimiter(const unsigned char* payload, size_t size) {
+			if constexpr (Framing::KIND == DELIMITED) {
+				return memchr(payload, Framing::DELIMITER, size) != nullptr;
+			}
+			else {
+				return false;
+			}
+		}
+
+		/*
+		- Returns the number of options that could not be set, see TcpTuning::apply.
+		*/
+		int set_tuning(const TcpTuning& tuning) {
+			if (corked) {
+				set_cork(false);
+			}
+			this->tuning = tuning;
+			return tuning.apply(m_socket);
+		}
+
+		const TcpTuning& get_tuning() {
+			return tuning;
+		}
+
+		/*
+		- Returns -2 if size is too big, see set_max_frame_size(). The default limit depends on
+		  the framing, 2^31-1 bytes for TcpSocket. With delimiter framing also if the payload
+		  contains the delimiter.
 		- Returns -1 if there is pending data to be sent. To clear pending data, call clear_send().
+		  In coalescing mode frames are appended to the pending data instead.
 		- Returns 1 if successfull.
 		*/
 		int set_send_data(std::vector<unsigned char> bytes) {
-			if (!data_send.empty()) {
+			if (exceeds_max_frame_size(bytes.size()) || contains_delimiter(bytes.data(), bytes.size())) {
+				return -2;
+			}
+			else if (coalesce_size > 0) {
+				if (bytes.size() < coalesce_size) {
+					coalesce(bytes.data(), bytes.size());
+				}
+				else {
+					seal_coalesced();
+					push_send_queue(shared_frame_type(std::move(bytes)));
+				}
+				return 1;
+			}
+			else if (!send_queue.empty()) {
 				return -1;
 			}
-			else if (bytes.size() > 0x7fffffff) {
+			else {
+				push_send_queue(shared_frame_type(std::move(bytes)));
+				return 1;
+			}
+		}
+
+		/*
+		Queues a frame behind any pending data, the frame storage is shared, not copied,
+		so the same frame can be queued on many sockets for broadcasting.
+		- Returns -2 if the frame is empty, too big or contains the delimiter.
+		- Returns 1 if successfull.
+		*/
+		int enqueue_frame(const shared_frame_type& frame) {
+			if (!frame || exceeds_max_frame_size(frame.payload_size())
+				|| contains_delimiter(frame.payload(), frame.payload_size())) {
 				return -2;
 			}
-			else {
-				data_send = bytes;
-				std::vector<unsigned char> size_bytes = {
-					static_cast<unsigned char>(bytes.size() >> 24),
-					static_cast<unsigned char>((bytes.size() >> 16) & 0x000000FF),
-					static_cast<unsigned char>((bytes.size() >> 8) & 0x000000FF),
-					static_cast<unsigned char>(bytes.size() & 0x000000FF)
-				};
-				data_send.insert(data_send.begin(), size_bytes.begin(), size_bytes.end());
+			if (coalesce_size > 0 && frame.payload_size() < coalesce_size) {
+				// small frames are cheaper to copy than to send on their own
+				coalesce(frame.payload(), frame.payload_size());
 				return 1;
 			}
+			seal_coalesced();
+			push_send_queue(frame);
+			return 1;
+		}
+
+		/*
+		Coalescing mode, frames smaller than flush_size are accumulated in a per connection
+		buffer and sent together once flush_size bytes are buffered, flush() is called or
+		max_delay has passed since the oldest buffered frame. send_data() only sends the
+		buffer once one of these is true, the event loop has to call it again by
+		flush_deadline(), with a timer finer than milliseconds for sub-millisecond delays
+		(TcpServer uses a timerfd). Pass a flush_size of 0 to disable coalescing.
+		*/
+		void enable_coalescing(size_t flush_size, std::chrono::microseconds max_delay) {
+			if (flush_size == 0) {
+				seal_coalesced();
+			}
+			coalesce_size = flush_size;
+			coalesce_delay = max_delay;
+		}
+
+		/*
+		Sends the coalescing buffer regardless of its size or deadline.
+		- Returns the same as send_data.
+		*/
+		int flush() {
+			seal_coalesced();
+			return send_data();
+		}
+
+		/*
+		- Returns the time by which send_data() has to be called for the buffered frames,
+		  time_point::max() if nothing is buffered.
+		*/
+		std::chrono::steady_clock::time_point flush_deadline() {
+			if (coalesce_buffer.empty()) {
+				return std::chrono::steady_clock::time_point::max();
+			}
+			return coalesce_started + coalesce_delay;
+		}
+
+		#ifdef __unix__
+		/*
+		Queues size bytes of the file fd from offset as one frame, behind any pending data like
+		enqueue_frame. The header and trailer go through the send queue, the payload is sent
+		with sendfile straight from the page cache without passing through userspace.
+		fd has to stay open and the file must not shrink until the frame is sent.
+		With delimiter framing the file is not checked for the delimiter, it must not contain it.
+		- Returns -2 if size is 0 or too big.
+		- Returns 1 if successfull.
+		*/
+		int enqueue_file(int fd, off_t offset, size_t size) {
+			if (size == 0 || exceeds_max_frame_size(size)) {
+				return -2;
+			}
+			seal_coalesced();
+			unsigned char header[Framing::MAX_HEADER_SIZE > 0 ? Framing::MAX_HEADER_SIZE : 1];
+			size_t header_size = Framing::encode_header(size, header);
+			if (header_size > 0) {
+				push_send_queue(shared_frame_type::encoded(std::vector<unsigned char>(header, header + header_size)));
+			}
+			file_sends.push_back({fd, offset, size, stream_queued});
+			stream_queued += size;
+			unsigned char trailer[Framing::MAX_TRAILER_SIZE > 0 ? Framing::MAX_TRAILER_SIZE : 1];
+			size_t trailer_size = Framing::encode_trailer(trailer);
+			if (trailer_size > 0) {
+				push_send_queue(shared_frame_type::encoded(std::vector<unsigned char>(trailer, trailer + trailer_size)));
+			}
+			return 1;
+		}
+
+		// file payload bytes queued with enqueue_file and not yet sent, they take no memory
+		size_t pending_file_bytes() {
+			size_t pending = 0;
+			for (const FileSend& file: file_sends) {
+				pending += file.remaining;
+			}
+			return pending;
+		}
+		#endif
+
+		// bytes held in the coalescing buffer, not yet handed to send_data
+		size_t coalesced_bytes() {
+			return coalesce_buffer.size();
+		}
+
+		// bytes queued or coalesced but not yet written to the socket, what backpressure is measured in
+		size_t pending_send_bytes() {
+			return queued_bytes - send_offset + coalesce_buffer.size();
 		}
 
 		/*
 		- Use only if there has been a disconnect.
 		*/
 		void clear_send() {
-			data_send.clear();
+			send_queue.clear();
+			queued_bytes = 0;
+			send_offset = 0;
+			coalesce_buffer.clear();
+			#ifdef __unix__
+			file_sends.clear();
+			#endif
+			stream_queued = 0;
+			stream_sent = 0;
 		}
 
 		/*
 		- Returns -2 if there is an error with data size
 		- Returns -1 if there is syscall error
 		- Returns 0 if connection is closed
-		- Returns 1 if sending is complete
+		- Returns 1 if sending is complete, in coalescing mode frames may still be
+		  buffered until their flush deadline
 		*/
 		int send_data() {
-			int size = data_send.size();
+			if (!coalesce_buffer.empty() && (coalesce_buffer.size() >= coalesce_size
+				|| std::chrono::steady_clock::now() >= flush_deadline())) {
+				seal_coalesced();
+			}
 
-			if (size <= 0) {
-				return -2;
+			if (!has_pending_send()) {
+				return coalesce_buffer.empty() ? -2 : 1;
+			}
+
+			if (tuning.adaptive && !corked && is_bulk_traffic()) {
+				set_cork(true);
 			}
 
 			do {
-				int r = send_wrapper(reinterpret_cast<char*>(data_send.data()), data_send.size(), 0);
+				#ifdef __unix__
+				if (!file_sends.empty() && file_sends.front().start == stream_sent) {
+					int r = send_file_chunk();
+					if (r != 1) {
+						return r;
+					}
+					continue;
+				}
+				#endif
+				IOVEC_TYPE iov[MAX_SEND_IOVECS];
+				bool zerocopy = false;
+				bool file_follows = false;
+				int count = fill_send_iovecs(iov, zerocopy, file_follows);
+				// keep the header in the same segment as the start of the file
+				int r = send_iovec_wrapper(iov, count, (zerocopy ? ZEROCOPY_FLAG : 0) | (file_follows ? MORE_FLAG : 0));
 				if (r == 0) {
 					return 0;
 				}
 				else if (r < 0) {
 					return -1;
 				}
-				data_send.erase(data_send.begin(), data_send.begin() + r);
-			} while (!data_send.empty());
-			return 1;			
+				#ifdef __unix__
+				if (zerocopy) {
+					// the kernel references the pages until completion, keep the frame alive
+					zerocopy_in_flight.push_back({zerocopy_next_id++, send_queue.front()});
+				}
+				#endif
+				consume_send_queue(r);
+			} while (has_pending_send());
+
+			if (corked) {
+				// queue drained, push out the partial segment held back by the cork
+				set_cork(false);
+			}
+			return 1;
+		}
+
+		#ifdef __unix__
+		/*
+		Sends frames with payloads of at least threshold bytes with MSG_ZEROCOPY, smaller frames
+		are still copied since page pinning and the completion costs more than copying them.
+		Sent frames are kept alive until the kernel reports completion, so call
+		process_zerocopy_completions() whenever polling reports POLLERR.
+		- Returns -1 if SO_ZEROCOPY is not supported.
+		- Returns 1 if successfull.
+		*/
+		int enable_zerocopy(size_t threshold = 32768) {
+			int flag = 1;
+			if (setsockopt(m_socket, SOL_SOCKET, SO_ZEROCOPY, &flag, sizeof(flag)) == SOCKET_ERROR) {
+				return -1;
+			}
+			zerocopy_threshold = threshold;
+			return 1;
+		}
+
+		/*
+		Drains the socket error queue, releases the frames whose zerocopy sends completed
+		and keeps TX timestamps for pop_tx_timestamp(). Call when polling reports POLLERR.
+		- Returns -1 if there is syscall error
+		- Returns the number of notifications read otherwise
+		*/
+		int process_error_queue() {
+			int processed = 0;
+			ErrorQueueEntry entry;
+			while (receive_error_queue(entry) == 1) {
+				processed++;
+				if (entry.is_tx_timestamp()) {
+					tx_timestamps.push_back(entry);
+				}
+				else if (entry.has_err && entry.err.ee_errno == 0 && entry.err.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+					complete_zerocopy(entry.err.ee_info, entry.err.ee_data, entry.err.ee_code);
+				}
+			}
+			if (errno != WOULDBLOCK_ERROR) {
+				return -1;
+			}
+			return processed;
+		}
+
+		/*
+		Releases the frames of completed zerocopy sends, see process_error_queue().
+		- Returns -1 if there is syscall error
+		- Returns the number of completed sends otherwise
+		*/
+		int process_zerocopy_completions() {
+			size_t before = zerocopy_in_flight.size();
+			if (process_error_queue() < 0) {
+				return -1;
+			}
+			return before - zerocopy_in_flight.size();
+		}
+
+		/*
+		TX timestamps need enable_timestamping() with TX_SOFTWARE_TIMESTAMPS or TX_HARDWARE_TIMESTAMPS,
+		entry.err.ee_data is the byte offset of the last byte of the timestamped send in the stream.
+		- Returns true if a timestamp was available.
+		*/
+		bool pop_tx_timestamp(ErrorQueueEntry& entry) {
+			if (tx_timestamps.empty()) {
+				process_error_queue();
+			}
+			if (tx_timestamps.empty()) {
+				return false;
+			}
+			entry = tx_timestamps.front();
+			tx_timestamps.pop_front();
+			return true;
+		}
+
+		// number of zerocopy sends whose frames are still held for the kernel
+		size_t zerocopy_pending() {
+			return zerocopy_in_flight.size();
+		}
+
+		// number of zerocopy sends the kernel had to fall back to copying for
+		size_t zerocopy_copied_count() {
+			return zerocopy_copied;
+		}
+
+		/*
+		RTT, congestion window, retransmits and queue sizes of the connection, see TcpInfoSample.
+		- Returns -1 on syscall error.
+		*/
+		int get_tcp_info(TcpInfoSample& sample) {
+			return sample_tcp_info(m_socket, sample);
+		}
+		#endif
+
+		SocketMemory memory_usage() {
+			SocketMemory memory;
+			memory.receive_buffer = data_receive.capacity();
+			memory.send_queue = queued_bytes;
+			memory.coalesce_buffer = coalesce_buffer.capacity();
+			memory.queues = send_queue.capacity() * sizeof(shared_frame_type);
+			#ifdef __unix__
+			memory.queues += tx_timestamps.capacity() * sizeof(ErrorQueueEntry) + zerocopy_in_flight.capacity() * sizeof(ZerocopySend)
+				+ file_sends.capacity() * sizeof(FileSend);
+			#endif
+			return memory;
+		}
+
+		/*
+		Gives back what the socket holds beyond its pending data, e.g. once a connection
+		went idle after a burst: drained queues release their rings, a partial frame its
+		spare capacity and receive_file its pipe between frames. Pending data is kept.
+		- Returns the number of bytes released, not counting the pipe.
+		*/
+		size_t shrink_buffers() {
+			size_t before = memory_usage().total();
+			if (Framing::KIND == LENGTH_PREFIXED && data_size_receive >= 0 && !frame_ready) {
+				// a partial frame is sized ahead of the bytes received
+				data_receive.resize(std::min<uint64_t>(data_receive.size(), data_index_receive));
+			}
+			data_receive.shrink_to_fit();
+			if (coalesce_buffer.empty()) {
+				coalesce_buffer = std::vector<unsigned char>();
+			}
+			send_queue.shrink_to_fit();
+			#ifdef __unix__
+			tx_timestamps.shrink_to_fit();
+			zerocopy_in_flight.shrink_to_fit();
+			file_sends.shrink_to_fit();
+			if (piped_bytes == 0 && data_size_receive < 0) {
+				splice_pipe.reset();
+			}
+			#endif
+			return before - memory_usage().total();
 		}
 
 		std::vector<unsigned char> dump_received_data() {
 			std::vector<unsigned char> data = std::move(data_receive);
 			data_receive.clear();
-			// we do not clear the index or the size, since they are used in other checks
+			frame_ready = false;
 			return data;
 		}
 
+		// part of a frame has been received, the rest is still outstanding
+		bool receive_in_progress() {
+			return !frame_ready && (header_index_receive > 0 || data_size_receive >= 0 || !data_receive.empty());
+		}
+
 		/*
 		- Returns -2 if there is an error with data size
 		- Returns -1 if there is syscall error
@@ -108,81 +528,477 @@ namespace cpp_socket::transportlayer {
 		- Returns 1 if data is available for dumping
 		*/
 		int receive_data() {
+			return receive_frame(nullptr);
+		}
+
+		#ifdef __unix__
+		/*
+		Receives the payload of the next frame straight into the file fd at offset with splice
+		(socket to pipe to file), instead of into memory. Call it instead of receive_data when
+		the next frame is known to be a file, non-blocking sockets call it again on readiness
+		until it returns 1, offset is only used when the frame starts. The frame size is not
+		limited by set_max_frame_size since nothing is buffered.
+		- Returns -2 if there is an error with data size
+		- Returns -1 if there is syscall error
+		- Returns 0 if connection is closed
+		- Returns 1 if the whole payload is written to the file
+		*/
+		int receive_file(int fd, off_t offset) {
+			static_assert(Framing::KIND == LENGTH_PREFIXED, "Files can only be received with length prefixed framing.");
+			int r = receive_size(nullptr, Framing::MAX_FRAME_SIZE);
+			if (r != 1) {
+				return r;
+			}
+			if (splice_pipe == nullptr) {
+				splice_pipe = std::make_unique<Pipe>();
+				splice_pipe->set_capacity(SPLICE_PIPE_SIZE);
+			}
+			if (data_index_receive == 0 && piped_bytes == 0) {
+				file_receive_offset = offset;
+			}
+
+			while (data_index_receive < static_cast<uint64_t>(data_size_receive)) {
+				if (piped_bytes == 0) {
+					size_t chunk = std::min<uint64_t>(data_size_receive - data_index_receive, SPLICE_PIPE_SIZE);
+					ssize_t n = splice(m_socket, nullptr, splice_pipe->write_fd(), nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+					if (n == 0) {
+						return 0;
+					}
+					else if (n < 0) {
+						return -1;
+					}
+					piped_bytes = n;
+				}
+				// the file side is drained completely, bytes left in the pipe belong to this frame
+				while (piped_bytes > 0) {
+					ssize_t n = splice(splice_pipe->read_fd(), nullptr, fd, &file_receive_offset, piped_bytes, SPLICE_F_MOVE);
+					if (n <= 0) {
+						return -1;
+					}
+					piped_bytes -= n;
+					data_index_receive += n;
+				}
+			}
+
+			data_size_receive = -1;
+			header_index_receive = 0;
+			return 1;
+		}
+
+		/*
+		Same as receive_data, also fills the RX timestamps of the read that completed the frame.
+		Needs enable_timestamping() with RX_SOFTWARE_TIMESTAMPS or RX_HARDWARE_TIMESTAMPS.
+		*/
+		int receive_data(PacketTimestamps& timestamps) {
+			return receive_frame(&timestamps);
+		}
+		#endif
+	private:
+		int receive_frame(PacketTimestamps* timestamps) {
 			// ensure the data is dumped if complete
-			if (!data_receive.empty() && data_index_receive == data_receive.size()) {
-				return 1; 
+			if (frame_ready) {
+				return 1;
 			}
 
+			int r;
+			if constexpr (Framing::KIND == LENGTH_PREFIXED) {
+				r = receive_length_prefixed(timestamps);
+			}
+			else if constexpr (Framing::KIND == DELIMITED) {
+				r = receive_delimited(timestamps);
+			}
+			else {
+				r = receive_stream(timestamps);
+			}
+
+			if (r != 1) {
+				return r;
+			}
+
+			#ifdef __unix__
+			if (tuning.quickack == 1) {
+				set_socket_option(IPPROTO_TCP, TCP_QUICKACK, 1);
+			}
+			#endif
+
+			frame_ready = true;
+			return 1;
+		}
+
+		// receives and parses the size header, if not already done
+		int receive_size(PacketTimestamps* timestamps, uint64_t limit) {
 			int r;
 
 			// get next data size, if not already received
-			while (size_bytes_index_receive < 4) {
-				unsigned char remaining = 4 - size_bytes_index_receive;
-				r = receive_wrapper(reinterpret_cast<char*>(&size_bytes_receive)+size_bytes_index_receive, remaining, 0);
+			size_t remaining;
+			while ((remaining = Framing::header_bytes_needed(header_receive, header_index_receive)) > 0) {
+				r = receive_chunk(reinterpret_cast<char*>(header_receive)+header_index_receive, remaining, 0, timestamps);
 				if (r == 0) {
 					return 0;
 				}
 				else if (r < 0) {
 					return -1;
 				}
-				size_bytes_index_receive += r;
+				header_index_receive += r;
 			}
 
 			// parse data size, if not already received
 			if (data_size_receive < 0) {
-				data_size_receive = 0;
-				data_size_receive = size_bytes_receive[0] << 24 | size_bytes_receive[1] << 16 | size_bytes_receive[2] << 8 | size_bytes_receive[3];
-				if (data_size_receive > 0) {
-					// reset data_receive_index and allocate memory for new data
-					// data_receive.clear(); // data_receive should be cleared already after dumping
-					data_receive.resize(data_size_receive);
-					data_index_receive = 0;
-				}
-				else {
-					data_size_receive = -1;
+				uint64_t size = Framing::decode_header(header_receive, header_index_receive);
+				if (size == 0 || size == INVALID_SIZE || size > limit) {
 					return -2; // error parsing data size
 				}
+				data_size_receive = size;
+				data_index_receive = 0;
+			}
+			return 1;
+		}
+
+		int receive_length_prefixed(PacketTimestamps* timestamps) {
+			int r = receive_size(timestamps, max_frame_size);
+			if (r != 1) {
+				return r;
 			}
 
 			// keep receiving if index hasn't reached the total data size
-			while (data_index_receive < data_size_receive) {
-				r = receive_wrapper(reinterpret_cast<char*>(data_receive.data())+data_index_receive, data_size_receive-data_index_receive, 0);
-				
-				if (r == 0) {
-					return 0;
+			while (data_index_receive < static_cast<uint64_t>(data_size_receive)) {
+				uint64_t remaining = data_size_receive - data_index_receive;
+				if (data_index_receive == 0 && remaining <= RECEIVE_SCRATCH_SIZE) {
+					// small frames allocate nothing until payload arrives, usually all of it in one read
+					std::vector<unsigned char>& scratch = receive_scratch();
+					r = receive_chunk(reinterpret_cast<char*>(scratch.data()), remaining, 0, timestamps);
+					if (r == 0) {
+						return 0;
+					}
+					else if (r < 0) {
+						return -1;
+					}
+					data_receive.assign(scratch.begin(), scratch.begin() + r);
+					data_index_receive = r;
+					continue;
 				}
-				else if (r < 0) {
-					return -1;
+
+				if (data_index_receive == data_receive.size()) {
+					/*
+					Grows with the bytes that arrived rather than to the announced size up front.
+					The buffer is only truncated to the bytes received once the frame is complete,
+					so every byte is zeroed by resize once, not before every read.
+					*/
+					data_receive.resize(std::min<uint64_t>(data_size_receive, std::max(data_receive.size() * 2, RECEIVE_SCRATCH_SIZE)));
+				}
+				size_t chunk = std::min<uint64_t>(remaining, data_receive.size() - data_index_receive);
+				r = receive_chunk(reinterpret_cast<char*>(data_receive.data())+data_index_receive, chunk, 0, timestamps);
+				
+				if (r <= 0) {
+					return r < 0 ? -1 : 0;
 				}
 
 				data_index_receive += r;
 			}
 
-			// reset total data size and size_bytes
+			// reset total data size and header
 			data_size_receive = -1;
-			size_bytes_index_receive = 0;
-			// memset(size_bytes_receive, 4, 0x0); 
+			header_index_receive = 0;
+			return 1;
+		}
+
+		/*
+		Peeks for the delimiter and only consumes up to it, so bytes of the next frame
+		stay in the socket and keep triggering readiness.
+		*/
+		int receive_delimited(PacketTimestamps* timestamps) {
+			std::vector<unsigned char>& scratch = receive_scratch();
+			while (true) {
+				size_t limit = max_frame_size + 1 - data_receive.size();
+				if (limit == 0) {
+					return -2; // no delimiter within the maximum frame size
+				}
+				size_t chunk = std::min<size_t>(limit, scratch.size());
+				int r = receive_chunk(reinterpret_cast<char*>(scratch.data()), chunk, MSG_PEEK, timestamps);
+				if (r <= 0) {
+					return r < 0 ? -1 : 0;
+				}
 
+				const void* delimiter = memchr(scratch.data(), Framing::DELIMITER, r);
+				size_t take = delimiter != nullptr ? static_cast<const unsigned char*>(delimiter) - scratch.data() + 1 : r;
+				size_t received = data_receive.size();
+				data_receive.resize(received + take);
+				r = receive_chunk(reinterpret_cast<char*>(data_receive.data()) + received, take, 0, timestamps);
+				if (r <= 0) {
+					data_receive.resize(received);
+					return r < 0 ? -1 : 0;
+				}
+
+				if (delimiter != nullptr && static_cast<size_t>(r) == take) {
+					// strip the delimiter
+					data_receive.resize(received + take - 1);
+					return 1;
+				}
+				data_receive.resize(received + r);
+			}
+		}
+
+		int receive_stream(PacketTimestamps* timestamps) {
+			std::vector<unsigned char>& scratch = receive_scratch();
+			size_t chunk = std::min<size_t>(max_frame_size, scratch.size());
+			int r = receive_chunk(reinterpret_cast<char*>(scratch.data()), chunk, 0, timestamps);
+			if (r <= 0) {
+				return r < 0 ? -1 : 0;
+			}
+			data_receive.assign(scratch.begin(), scratch.begin() + r);
 			return 1;
 		}
-	private:
+
+		// read buffer shared by all sockets of the thread, data is only copied out once received
+		static std::vector<unsigned char>& receive_scratch() {
+			static thread_local std::vector<unsigned char> scratch(RECEIVE_SCRATCH_SIZE);
+			return scratch;
+		}
+
+		int receive_chunk(char* buf, size_t len, int flags, PacketTimestamps* timestamps) {
+			int n = static_cast<int>(std::min<size_t>(len, std::numeric_limits<int>::max()));
+			#ifdef __unix__
+			if (timestamps != nullptr) {
+				return receive_timestamped(buf, n, flags, *timestamps);
+			}
+			#endif
+			return receive_wrapper(buf, n, flags);
+		}
+
+		// up to three iovecs (header, payload and trailer) per frame
+		static constexpr int MAX_SEND_IOVECS = 64;
+		static constexpr size_t RECEIVE_SCRATCH_SIZE = 65536;
+
+		#ifdef __unix__
+			static constexpr int ZEROCOPY_FLAG = MSG_ZEROCOPY;
+			static constexpr int MORE_FLAG = MSG_MORE;
+			// bytes moved per sendfile call, and the pipe size for receive_file
+			static constexpr size_t SENDFILE_CHUNK = 1 << 20;
+			static constexpr int SPLICE_PIPE_SIZE = 1 << 20;
+		#else
+			static constexpr int ZEROCOPY_FLAG = 0;
+			static constexpr int MORE_FLAG = 0;
+		#endif
+
+		bool has_pending_send() {
+			#ifdef __unix__
+			if (!file_sends.empty()) {
+				return true;
+			}
+			#endif
+			return !send_queue.empty();
+		}
+
+		// position in the stream where the next file starts, frames past it wait for the file
+		uint64_t next_file_start() {
+			#ifdef __unix__
+			if (!file_sends.empty()) {
+				return file_sends.front().start;
+			}
+			#endif
+			return std::numeric_limits<uint64_t>::max();
+		}
+
+		#ifdef __unix__
+		/*
+		- Returns -2 if the file ended before the announced size, the stream is corrupt then.
+		- Returns -1 if there is syscall error.
+		- Returns 1 if some bytes were sent.
+		*/
+		int send_file_chunk() {
+			FileSend& file = file_sends.front();
+			ssize_t r = sendfile(m_socket, file.fd, &file.offset, std::min(file.remaining, SENDFILE_CHUNK));
+			if (r == 0) {
+				return -2;
+			}
+			else if (r < 0) {
+				return -1;
+			}
+			file.remaining -= r;
+			file.start += r;
+			stream_sent += r;
+			if (file.remaining == 0) {
+				file_sends.pop_front();
+			}
+			return 1;
+		}
+		#endif
+
+		bool is_zerocopy_frame(const shared_frame_type& frame) {
+			return zerocopy_threshold > 0 && frame.payload_size() >= zerocopy_threshold;
+		}
+
+		/*
+		A frame large enough for zerocopy is sent on its own so that no small frames
+		get pinned along with it, small frames are gathered up to the next large one.
+		*/
+		int fill_send_iovecs(IOVEC_TYPE* iov, bool& zerocopy, bool& file_follows) {
+			int count = 0;
+			size_t offset = send_offset;
+			// files start at a frame boundary
+			uint64_t budget = next_file_start() - stream_sent;
+			zerocopy = is_zerocopy_frame(send_queue.front());
+			for (auto it = send_queue.begin(); it != send_queue.end() && count < MAX_SEND_IOVECS && budget > 0; ++it) {
+				if (it != send_queue.begin() && (zerocopy || is_zerocopy_frame(*it))) {
+					break;
+				}
+				budget -= std::min<uint64_t>(budget, it->size() - (it == send_queue.begin() ? send_offset : 0));
+				add_send_iovec(iov, count, it->header(), it->header_size(), offset);
+				add_send_iovec(iov, count, it->payload(), it->payload_size(), offset);
+				add_send_iovec(iov, count, it->trailer(), it->trailer_size(), offset);
+			}
+			file_follows = budget == 0;
+			return count;
+		}
+
+		// adds the part of buf past offset, offset is consumed by the parts already sent
+		void add_send_iovec(IOVEC_TYPE* iov, int& count, const unsigned char* buf, size_t len, size_t& offset) {
+			if (offset >= len) {
+				offset -= len;
+				return;
+			}
+			if (count < MAX_SEND_IOVECS) {
+				set_iovec(iov[count++], buf + offset, len - offset);
+			}
+			offset = 0;
+		}
+
+		void consume_send_queue(size_t sent) {
+			stream_sent += sent;
+			sent += send_offset;
+			while (!send_queue.empty() && sent >= send_queue.front().size()) {
+				sent -= send_queue.front().size();
+				queued_bytes -= send_queue.front().size();
+				if (tuning.adaptive) {
+					average_frame_size += (static_cast<double>(send_queue.front().size()) - average_frame_size) / 8;
+				}
+				send_queue.pop_front();
+			}
+			send_offset = sent;
+		}
+
+		void coalesce(const unsigned char* payload, size_t size) {
+			if (coalesce_buffer.empty()) {
+				coalesce_buffer.reserve(coalesce_size + Framing::MAX_HEADER_SIZE + Framing::MAX_TRAILER_SIZE);
+				coalesce_started = std::chrono::steady_clock::now();
+			}
+			unsigned char header[Framing::MAX_HEADER_SIZE > 0 ? Framing::MAX_HEADER_SIZE : 1];
+			unsigned char trailer[Framing::MAX_TRAILER_SIZE > 0 ? Framing::MAX_TRAILER_SIZE : 1];
+			size_t header_size = Framing::encode_header(size, header);
+			size_t trailer_size = Framing::encode_trailer(trailer);
+			coalesce_buffer.insert(coalesce_buffer.end(), header, header + header_size);
+			coalesce_buffer.insert(coalesce_buffer.end(), payload, payload + size);
+			coalesce_buffer.insert(coalesce_buffer.end(), trailer, trailer + trailer_size);
+		}
+
+		// moves the coalescing buffer to the send queue, keeping the order with frames queued after it
+		void seal_coalesced() {
+			if (!coalesce_buffer.empty()) {
+				push_send_queue(shared_frame_type::encoded(std::move(coalesce_buffer)));
+				coalesce_buffer = std::vector<unsigned char>();
+			}
+		}
+
+		void push_send_queue(const shared_frame_type& frame) {
+			queued_bytes += frame.size();
+			stream_queued += frame.size();
+			send_queue.push_back(frame);
+		}
+
+		bool is_bulk_traffic() {
+			return average_frame_size >= tuning.adaptive_bulk_frame_size
+				|| send_queue.size() >= tuning.adaptive_bulk_queue_depth;
+		}
+
+		// windows has no TCP_CORK, nagle is the closest thing to it
+		void set_cork(bool cork) {
+			#ifdef __unix__
+				set_socket_option(IPPROTO_TCP, TCP_CORK, cork ? 1 : 0);
+			#else
+				set_socket_option(IPPROTO_TCP, TCP_NODELAY, cork ? 0 : 1);
+			#endif
+			corked = cork;
+		}
+
 		Address createAddress(address_family_t ip_protocol, std::string ip, int port) {
 			Address address(ip_protocol);
 			address.set_address(ip, port);
 			return address;
 		}
 
-		std::vector<unsigned char> data_send;
+		TcpTuning tuning;
+		bool corked = false;
+		// moving average of the frame sizes sent, only tracked in adaptive mode
+		double average_frame_size = 0;
+
+		uint64_t max_frame_size = Framing::DEFAULT_MAX_FRAME_SIZE;
+
+		RingQueue<shared_frame_type> send_queue;
+		// total size of the frames in send_queue
+		size_t queued_bytes = 0;
+		// bytes of the front frame that are already sent
+		size_t send_offset = 0;
+		// bytes queued and sent since the start, to order frames and files
+		uint64_t stream_queued = 0;
+		uint64_t stream_sent = 0;
+
+		// 0 means coalescing is disabled
+		size_t coalesce_size = 0;
+		std::chrono::microseconds coalesce_delay{0};
+		std::chrono::steady_clock::time_point coalesce_started;
+		std::vector<unsigned char> coalesce_buffer;
 
-		int data_size_receive = -1;
-		unsigned char size_bytes_receive[4] = {0x0, 0x0, 0x0, 0x0};
+		// 0 means zerocopy is disabled
+		size_t zerocopy_threshold = 0;
+		#ifdef __unix__
+			void complete_zerocopy(uint32_t lo, uint32_t hi, uint8_t code) {
+				// lo to hi is the inclusive range of completed send calls
+				if (code & SO_EE_CODE_ZEROCOPY_COPIED) {
+					zerocopy_copied += hi - lo + 1;
+				}
+				zerocopy_in_flight.erase_if([lo, hi](const ZerocopySend& z) {
+					return z.id - lo <= hi - lo;
+				});
+			}
+
+			RingQueue<ErrorQueueEntry> tx_timestamps;
+
+			struct ZerocopySend {
+				uint32_t id;
+				shared_frame_type frame;
+			};
+			RingQueue<ZerocopySend> zerocopy_in_flight;
+			uint32_t zerocopy_next_id = 0;
+			size_t zerocopy_copied = 0;
+
+			struct FileSend {
+				int fd;
+				off_t offset;
+				size_t remaining;
+				// stream position of the next payload byte to send
+				uint64_t start;
+			};
+			RingQueue<FileSend> file_sends;
+
+			// created by the first receive_file
+			std::unique_ptr<Pipe> splice_pipe;
+			// bytes spliced into the pipe but not yet into the file
+			size_t piped_bytes = 0;
+			off_t file_receive_offset = 0;
+		#endif
+
+		int64_t data_size_receive = -1;
+		unsigned char header_receive[Framing::MAX_HEADER_SIZE > 0 ? Framing::MAX_HEADER_SIZE : 1] = {};
 		std::vector<unsigned char> data_receive;
+		bool frame_ready = false;
 		
 		// starting index to be received, including the start
 		// once all bytes are received, index will be len, which will be out of range
-		unsigned int data_index_receive = 0;
-		unsigned char size_bytes_index_receive = 0; 
+		uint64_t data_index_receive = 0;
+		unsigned char header_index_receive = 0; 
 	};
+
+	using TcpSocket = BasicTcpSocket<DefaultFraming>;
 } // namespace cpp_socket::transportlayer
 
 #endif // TCP_SOCKET_H
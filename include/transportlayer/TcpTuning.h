@@ -0,0 +1,93 @@
+#ifndef TCP_TUNING_H
+#define TCP_TUNING_H
+
+#include <base/SocketWrapper.h>
+
+#ifdef __unix__
+	#include <netinet/tcp.h>
+#endif
+
+namespace cpp_socket::transportlayer {
+	enum tuning_profile_t {
+		DEFAULT_TUNING,
+		LOW_LATENCY,
+		BULK_THROUGHPUT,
+		BALANCED,
+		ADAPTIVE
+	};
+
+	/*
+	Socket options applied to a TcpSocket at construction and on accept.
+	Options set to -1 are left at the system default.
+	*/
+	struct TcpTuning {
+		int nodelay = -1;
+		// linux only, re-armed after every received frame since the kernel clears it
+		int quickack = -1;
+		int send_buffer = -1;
+		int receive_buffer = -1;
+		// linux only, microseconds to busy poll the device queue on blocking reads
+		int busy_poll_us = -1;
+
+		/*
+		Observe the frames going through send_data and cork while bulk data is queued,
+		uncorking once the queue drains, small sparse frames go out immediately.
+		*/
+		bool adaptive = false;
+		size_t adaptive_bulk_frame_size = 16384;
+		size_t adaptive_bulk_queue_depth = 8;
+
+		static TcpTuning from_profile(tuning_profile_t profile) {
+			TcpTuning tuning;
+			switch (profile) {
+				case DEFAULT_TUNING:
+					break;
+				case LOW_LATENCY:
+					tuning.nodelay = 1;
+					tuning.quickack = 1;
+					tuning.busy_poll_us = 50;
+					break;
+				case BULK_THROUGHPUT:
+					tuning.nodelay = 0;
+					tuning.send_buffer = 4 * 1024 * 1024;
+					tuning.receive_buffer = 4 * 1024 * 1024;
+					break;
+				case BALANCED:
+					tuning.nodelay = 1;
+					break;
+				case ADAPTIVE:
+					tuning.nodelay = 1;
+					tuning.adaptive = true;
+					break;
+				default:
+					throw std::runtime_error("Unrecognized tuning profile.");
+			}
+			return tuning;
+		}
+
+		/*
+		Best effort, options the platform or the process privileges do not allow are skipped.
+		- Returns the number of options that could not be set.
+		*/
+		int apply(SOCKET_TYPE socket) const {
+			int failed = 0;
+			failed += set(socket, IPPROTO_TCP, TCP_NODELAY, nodelay);
+			failed += set(socket, SOL_SOCKET, SO_SNDBUF, send_buffer);
+			failed += set(socket, SOL_SOCKET, SO_RCVBUF, receive_buffer);
+			#ifdef __unix__
+				failed += set(socket, IPPROTO_TCP, TCP_QUICKACK, quickack);
+				failed += set(socket, SOL_SOCKET, SO_BUSY_POLL, busy_poll_us);
+			#endif
+			return failed;
+		}
+
+		static int set(SOCKET_TYPE socket, int level, int name, int value) {
+			if (value < 0) {
+				return 0;
+			}
+			return setsockopt(socket, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) == SOCKET_ERROR ? 1 : 0;
+		}
+	};
+} // namespace cpp_socket::transportlayer
+
+#endif // TCP_TUNING_H
@@ -0,0 +1,327 @@
+#ifndef UDP_SOCKET_H
+#define UDP_SOCKET_H
+
+#include <base/SocketWrapper.h>
+#include <netinet/udp.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using cpp_socket::base::SocketWrapper;
+using cpp_socket::base::Address;
+using cpp_socket::base::address_family_t;
+
+#ifdef _WIN32
+	#error "Windows not supported"
+#endif
+
+namespace cpp_socket::transportlayer {
+	/*
+	One datagram to send, or with segment_size set a buffer the kernel cuts into
+	datagrams of segment_size bytes (UDP GSO), the last one may be shorter.
+	*/
+	struct Datagram {
+		const void* data = nullptr;
+		size_t size = 0;
+		// nullptr on a connected socket
+		Address* destination = nullptr;
+		// 0 sends data as a single datagram, at most UdpSocket::MAX_GSO_SEGMENTS segments
+		uint16_t segment_size = 0;
+	};
+
+	/*
+	Receive buffers for UdpSocket::receive_batch, allocated once and reused for every call.
+	With GRO the kernel hands over several datagrams of one flow in a single buffer,
+	segments() splits them again so they read like separate datagrams.
+	*/
+	class UdpReceiveBatch {
+	public:
+		struct Segment {
+			const unsigned char* data;
+			size_t size;
+			// index of the received message, for source()
+			int message;
+		};
+
+		/*
+		- messages: datagrams (or GRO buffers) per recvmmsg call.
+		- buffer_size: bytes per message, keep the 65535 default with GRO, coalesced buffers
+		  that do not fit are truncated.
+		*/
+		explicit UdpReceiveBatch(int messages = 32, size_t buffer_size = 65535)
+			:buffer_size(buffer_size), storage(messages * buffer_size), headers(messages),
+			iovecs(messages), addresses(messages), controls(messages) {
+			if (messages <= 0 || buffer_size == 0) {
+				throw std::runtime_error("Receive batch must not be empty.");
+			}
+			for (int i = 0; i < messages; i++) {
+				SocketWrapper::set_iovec(iovecs[i], &storage[i * buffer_size], buffer_size);
+				headers[i].msg_hdr.msg_iov = &iovecs[i];
+				headers[i].msg_hdr.msg_iovlen = 1;
+			}
+		}
+
+		UdpReceiveBatch(const UdpReceiveBatch&) = delete;
+		UdpReceiveBatch& operator=(const UdpReceiveBatch&) = delete;
+
+		// number of messages filled by the last receive_batch
+		int size() {
+			return received;
+		}
+
+		int capacity() {
+			return static_cast<int>(headers.size());
+		}
+
+		// the datagrams of the last receive_batch, GRO buffers split into their segments
+		const std::vector<Segment>& segments() {
+			return split;
+		}
+
+		Address source(int message) {
+			const sockaddr_storage& address = addresses[message];
+			return Address(address, static_cast<address_family_t>(address.ss_family));
+		}
+
+		// the datagram did not fit the buffer and was cut off
+		bool is_truncated(int message) {
+			return (headers[message].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+		}
+	private:
+		friend class UdpSocket;
+
+		struct alignas(cmsghdr) Control {
+			char data[CMSG_SPACE(sizeof(int))];
+		};
+
+		// recvmmsg overwrites the lengths, reset them before every call
+		void prepare() {
+			for (size_t i = 0; i < headers.size(); i++) {
+				msghdr& header = headers[i].msg_hdr;
+				header.msg_name = &addresses[i];
+				header.msg_namelen = sizeof(sockaddr_storage);
+				header.msg_control = controls[i].data;
+				header.msg_controllen = sizeof(controls[i].data);
+				header.msg_flags = 0;
+			}
+			split.clear();
+			received = 0;
+		}
+
+		void collect(int count) {
+			received = count;
+			for (int i = 0; i < count; i++) {
+				msghdr& header = headers[i].msg_hdr;
+				const unsigned char* data = &storage[i * buffer_size];
+				size_t length = headers[i].msg_len;
+				size_t segment_size = length;
+				for (cmsghdr* cm = CMSG_FIRSTHDR(&header); cm != nullptr; cm = CMSG_NXTHDR(&header, cm)) {
+					if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+						int gso_size;
+						memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+						if (gso_size > 0) {
+							segment_size = gso_size;
+						}
+					}
+				}
+				if (length == 0) {
+					split.push_back({data, 0, i});
+					continue;
+				}
+				for (size_t offset = 0; offset < length; offset += segment_size) {
+					split.push_back({data + offset, std::min(segment_size, length - offset), i});
+				}
+			}
+		}
+
+		size_t buffer_size;
+		std::vector<unsigned char> storage;
+		std::vector<mmsghdr> headers;
+		std::vector<iovec> iovecs;
+		std::vector<sockaddr_storage> addresses;
+		std::vector<Control> controls;
+		std::vector<Segment> split;
+		int received = 0;
+	};
+
+	/*
+	UDP socket, unconnected by default: bound to a local address, every send names its
+	destination. After connect_to() it only talks to that peer and sends need no address.
+	Batches go out with sendmmsg and come in with recvmmsg, and with GSO/GRO one syscall
+	and one pass through the stack carry up to 64 datagrams.
+	*/
+	class UdpSocket: public SocketWrapper {
+	public:
+		// sendmmsg calls are split into chunks of this many messages
+		static constexpr int MAX_BATCH = 64;
+		// kernel limit of segments per GSO send
+		static constexpr int MAX_GSO_SEGMENTS = 64;
+
+		/*
+		Binds to ip:port, pass an empty ip for any address and port 0 for an ephemeral port.
+		*/
+		UdpSocket(address_family_t ip_protocol, std::string ip, int port, bool blocking)
+			:SocketWrapper(ip_protocol, SOCK_DGRAM, 0, create_address(ip_protocol, ip, port, true), blocking) {
+
+		}
+
+		static Address create_address(address_family_t ip_protocol, std::string ip, int port, bool bind_only = false) {
+			Address address(ip_protocol);
+			address.set_address(ip, port);
+			if (bind_only) {
+				address.set_bind_only();
+			}
+			return address;
+		}
+
+		/*
+		Switches to connected mode: datagrams from other peers are dropped by the kernel
+		and sends without destination go to this peer.
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int connect_to(std::string ip, int port) {
+			Address peer = create_address(address.get_address_family(), ip, port);
+			if (connect(m_socket, peer.get_sockaddr(), peer.size()) == SOCKET_ERROR) {
+				return SOCKET_ERROR;
+			}
+			connected = true;
+			return 0;
+		}
+
+		// port the socket is bound to, useful after binding port 0
+		int get_local_port() {
+			sockaddr_storage local;
+			socklen_t size = sizeof(local);
+			if (getsockname(m_socket, reinterpret_cast<sockaddr*>(&local), &size) == SOCKET_ERROR) {
+				return -1;
+			}
+			if (local.ss_family == AF_INET6) {
+				return ntohs(reinterpret_cast<sockaddr_in6*>(&local)->sin6_port);
+			}
+			return ntohs(reinterpret_cast<sockaddr_in*>(&local)->sin_port);
+		}
+
+		/*
+		- destination: nullptr on a connected socket.
+		- Returns the number of bytes sent, SOCKET_ERROR on syscall error.
+		*/
+		int send_datagram(const void* data, size_t size, Address* destination = nullptr) {
+			return send_segmented(data, size, 0, destination);
+		}
+
+		/*
+		GSO send: one syscall for data cut into datagrams of segment_size bytes.
+		- Returns the number of bytes sent, SOCKET_ERROR on syscall error (EINVAL if
+		  the kernel or the route does not support GSO, or there are too many segments).
+		*/
+		int send_segmented(const void* data, size_t size, uint16_t segment_size, Address* destination = nullptr) {
+			msghdr msg{};
+			iovec iov;
+			Control control;
+			fill_message(msg, iov, control, {data, size, destination, segment_size});
+			return sendmsg(m_socket, &msg, 0);
+		}
+
+		/*
+		Sends count datagrams with as few sendmmsg calls as possible.
+		- Returns the number of datagrams sent, which is less than count if the socket
+		  buffer filled up, SOCKET_ERROR if not even the first one could be sent.
+		*/
+		int send_batch(const Datagram* datagrams, int count) {
+			int sent = 0;
+			while (sent < count) {
+				int n = std::min(count - sent, MAX_BATCH);
+				mmsghdr messages[MAX_BATCH];
+				iovec iovs[MAX_BATCH];
+				Control controls[MAX_BATCH];
+				for (int i = 0; i < n; i++) {
+					messages[i].msg_hdr = msghdr{};
+					messages[i].msg_len = 0;
+					fill_message(messages[i].msg_hdr, iovs[i], controls[i], datagrams[sent + i]);
+				}
+				int r = sendmmsg(m_socket, messages, n, 0);
+				if (r == SOCKET_ERROR) {
+					return sent > 0 ? sent : SOCKET_ERROR;
+				}
+				sent += r;
+				if (r < n) {
+					break;
+				}
+			}
+			return sent;
+		}
+
+		/*
+		- source: optional, filled with the sender.
+		- Returns the size of the datagram, SOCKET_ERROR on syscall error.
+		*/
+		int receive_datagram(void* buffer, size_t size, Address* source = nullptr) {
+			sockaddr_storage from;
+			socklen_t from_size = sizeof(from);
+			int r = recvfrom(m_socket, buffer, size, 0, reinterpret_cast<sockaddr*>(&from), &from_size);
+			if (r >= 0 && source != nullptr) {
+				*source = Address(from, static_cast<address_family_t>(from.ss_family));
+			}
+			return r;
+		}
+
+		/*
+		Fills the batch with as many datagrams as are queued, waiting only for the first
+		one on a blocking socket.
+		- Returns the number of messages received, SOCKET_ERROR on syscall error,
+		  WOULDBLOCK_ERROR if nothing is queued.
+		*/
+		int receive_batch(UdpReceiveBatch& batch) {
+			batch.prepare();
+			int r = recvmmsg(m_socket, batch.headers.data(), batch.capacity(), MSG_WAITFORONE, nullptr);
+			if (r > 0) {
+				batch.collect(r);
+			}
+			return r;
+		}
+
+		/*
+		Every send without its own segment_size is cut into datagrams of this size, 0 disables.
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int set_segment_size(uint16_t segment_size) {
+			return set_socket_option(SOL_UDP, UDP_SEGMENT, segment_size);
+		}
+
+		/*
+		Lets the kernel coalesce datagrams of a flow into one receive buffer, split again
+		by UdpReceiveBatch::segments(). Receive with receive_batch only, receive_datagram
+		cannot tell the segments apart.
+		- Returns SOCKET_ERROR on syscall error.
+		*/
+		int enable_gro(bool enable) {
+			return set_socket_option(SOL_UDP, UDP_GRO, enable ? 1 : 0);
+		}
+	private:
+		struct alignas(cmsghdr) Control {
+			char data[CMSG_SPACE(sizeof(uint16_t))];
+		};
+
+		void fill_message(msghdr& msg, iovec& iov, Control& control, const Datagram& datagram) {
+			set_iovec(iov, datagram.data, datagram.size);
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			if (datagram.destination != nullptr) {
+				msg.msg_name = datagram.destination->get_sockaddr();
+				msg.msg_namelen = datagram.destination->size();
+			}
+			if (datagram.segment_size > 0) {
+				msg.msg_control = control.data;
+				msg.msg_controllen = sizeof(control.data);
+				cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				memcpy(CMSG_DATA(cm), &datagram.segment_size, sizeof(uint16_t));
+			}
+		}
+	};
+} // namespace cpp_socket::transportlayer
+
+#endif // UDP_SOCKET_H